@@ -0,0 +1,163 @@
+// Halide tutorial lesson 9: Auto-scheduling the blur and producer/consumer pipelines
+// Halide入门教程第九课：用自动调度器为模糊和生产者-消费者流水线生成调度
+
+// So far every schedule in these lessons was written by hand. This
+// lesson takes the clamped blur from lesson 7 and the
+// producer/consumer pipeline from lesson 8, wraps them in Generators,
+// and lets one of Halide's auto-schedulers (Mullapudi2016, Adams2019
+// or Li2018) write the schedule instead. The generated schedule is
+// emitted as C++ source next to the compiled pipeline, and
+// lesson_09_auto_scheduler_run.cpp benchmarks it against the
+// hand-written schedule from lessons 7 and 8.
+// 前面几课的调度都是手写的。本课把第七课的模糊和第八课的生产者-消费者流水线封装成Generator，
+// 让自动调度器生成调度，并把生成的调度以C++源码的形式输出，方便和手写调度进行对比。
+
+// On linux, you can compile and run it like so:
+// 在linux上按如下方式编译生成器：
+// g++ lesson_09*generate.cpp ../tools/GenGen.cpp -g -std=c++11 -fno-rtti -I ../include -L ../bin -lHalide -lpthread -ldl -o lesson_09_generate
+//
+// Then run the generator once per pipeline and per schedule. The
+// hand-written schedule:
+// 手写调度：
+// LD_LIBRARY_PATH=../bin ./lesson_09_generate -g lesson_09_blur -f blur_manual -o . -e static_library,h target=host auto_schedule=false
+// LD_LIBRARY_PATH=../bin ./lesson_09_generate -g lesson_09_producer_consumer -f pc_manual -o . -e static_library,h target=host-no_runtime auto_schedule=false
+//
+// And each auto-scheduler, loaded as a plugin. The 'schedule' emit
+// option writes the chosen schedule to <name>.schedule.h:
+// 每个自动调度器以插件的形式加载，'schedule'选项会把生成的调度写到<name>.schedule.h中：
+// LD_LIBRARY_PATH=../bin ./lesson_09_generate -g lesson_09_blur -f blur_mullapudi2016 -o . -e static_library,h,schedule -p ../bin/libautoschedule_mullapudi2016.so -s Mullapudi2016 target=host-no_runtime auto_schedule=true
+// LD_LIBRARY_PATH=../bin ./lesson_09_generate -g lesson_09_blur -f blur_adams2019 -o . -e static_library,h,schedule -p ../bin/libautoschedule_adams2019.so -s Adams2019 target=host-no_runtime auto_schedule=true
+// LD_LIBRARY_PATH=../bin ./lesson_09_generate -g lesson_09_blur -f blur_li2018 -o . -e static_library,h,schedule -p ../bin/libautoschedule_li2018.so -s Li2018 target=host-no_runtime auto_schedule=true
+//
+// Repeat the three lines above with '-g lesson_09_producer_consumer'
+// and the names pc_mullapudi2016, pc_adams2019 and pc_li2018. Then
+// build lesson_09_auto_scheduler_run.cpp as described in that file.
+//
+// All eight libraries are linked into one program, which needs exactly
+// one copy of the Halide runtime: each copy brings its own thread pool
+// and runtime state. So blur_manual carries the runtime and the other
+// seven are built with no_runtime.
+// 八个库都链接到同一个程序中，而程序中只能有一份Halide运行时：每一份运行时都有自己的线程池和运行时状态。
+// 所以只有blur_manual包含运行时，其余七个库都使用no_runtime编译。
+//
+// The auto-schedulers also take a description of the machine. The
+// default is fine for a typical desktop; for a big server you can
+// pass e.g. machine_params=32,16777216,40 (cores, last level cache
+// size in bytes, relative cost of a load from memory).
+// 自动调度器还需要机器的参数（核数，最后一级缓存大小，访存代价），默认值适用于普通台式机。
+
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// The size of the frames we expect to see in production. The
+// auto-schedulers only see these estimates, so they should describe
+// the real workload rather than the small images used for tracing in
+// the earlier lessons.
+// 生产环境中的图像尺寸。自动调度器只能看到这些估计值，所以它们应该描述真实的负载，
+// 而不是前几课中用于跟踪的小图像。
+static const int kEstimateWidth = 3840;
+static const int kEstimateHeight = 2160;
+
+// The clamped blur from lesson 7.
+// 第七课中带边界条件的模糊
+class Lesson09Blur : public Generator<Lesson09Blur> {
+public:
+    Input<Buffer<uint8_t>> input{"input", 3};
+    Output<Buffer<uint8_t>> output{"output", 3};
+
+    void generate() {
+        clamped = BoundaryConditions::repeat_edge(input);
+
+        input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+
+        blur_x(x, y, c) = (input_16(x-1, y, c) +
+                           2 * input_16(x, y, c) +
+                           input_16(x+1, y, c)) / 4;
+
+        blur_y(x, y, c) = (blur_x(x, y-1, c) +
+                           2 * blur_x(x, y, c) +
+                           blur_x(x, y+1, c)) / 4;
+
+        output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+    }
+
+    void schedule() {
+        if (auto_schedule) {
+            // The auto-schedulers need to know how big the inputs
+            // and outputs are going to be. The blur always runs over
+            // three channels.
+            // 自动调度器需要知道输入输出的大小
+            input.set_estimates({{0, kEstimateWidth}, {0, kEstimateHeight}, {0, 3}});
+            output.set_estimates({{0, kEstimateWidth}, {0, kEstimateHeight}, {0, 3}});
+        } else {
+            // The hand-written schedule: compute the output in
+            // parallel strips of scanlines, vectorized across x, and
+            // compute the horizontal blur per strip, like the mixed
+            // schedule from lesson 8.
+            // 手写调度：与第八课的混合调度相同，按行条带并行，x方向向量化
+            Var yo("yo"), yi("yi");
+            const int vec = natural_vector_size<uint16_t>();
+            output
+                .reorder(x, y, c)
+                .split(y, yo, yi, 32)
+                .parallel(yo)
+                .vectorize(x, vec);
+            blur_x
+                .store_at(output, yo)
+                .compute_at(output, yi)
+                .vectorize(x, vec);
+        }
+    }
+
+private:
+    Var x{"x"}, y{"y"}, c{"c"};
+    Func clamped{"clamped"}, input_16{"input_16"};
+    Func blur_x{"blur_x"}, blur_y{"blur_y"};
+};
+
+// The producer/consumer pipeline from lesson 8.
+// 第八课中的生产者-消费者流水线
+class Lesson09ProducerConsumer : public Generator<Lesson09ProducerConsumer> {
+public:
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        producer(x, y) = sin(x * y);
+        output(x, y) = (producer(x, y) +
+                        producer(x, y+1) +
+                        producer(x+1, y) +
+                        producer(x+1, y+1))/4;
+    }
+
+    void schedule() {
+        if (auto_schedule) {
+            // There is no input, so only the output needs an estimate.
+            // 没有输入，只需要给出输出的估计值
+            output.set_estimates({{0, kEstimateWidth}, {0, kEstimateHeight}});
+        } else {
+            // This is exactly the schedule of producer_mixed /
+            // consumer_mixed in lesson 8, with the vector width taken
+            // from the target instead of hard-coded to four.
+            // 与第八课的producer_mixed/consumer_mixed调度相同
+            Var yo("yo"), yi("yi");
+            const int vec = natural_vector_size<float>();
+            output
+                .split(y, yo, yi, 16)
+                .parallel(yo)
+                .vectorize(x, vec);
+            producer
+                .store_at(output, yo)
+                .compute_at(output, yi)
+                .vectorize(x, vec);
+        }
+    }
+
+private:
+    Var x{"x"}, y{"y"};
+    Func producer{"producer"};
+};
+
+HALIDE_REGISTER_GENERATOR(Lesson09Blur, lesson_09_blur)
+HALIDE_REGISTER_GENERATOR(Lesson09ProducerConsumer, lesson_09_producer_consumer)
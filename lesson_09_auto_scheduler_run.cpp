@@ -0,0 +1,127 @@
+// Halide tutorial lesson 9: Auto-scheduling the blur and producer/consumer pipelines
+// Halide入门教程第九课：用自动调度器为模糊和生产者-消费者流水线生成调度
+
+// This is the second half of lesson 9. It links the pipelines
+// produced by lesson_09_auto_scheduler_generate.cpp and times the
+// hand-written schedule against each auto-scheduler at production
+// size. See that file for how to produce the static libraries.
+// 本文件是第九课的第二部分，链接生成器产生的静态库，在生产尺寸下比较手写调度和各个自动调度器的性能。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_09*run.cpp blur_*.a pc_*.a -g -std=c++11 -I ../include -I ../tools -I . -lpthread -ldl -o lesson_09_run
+// ./lesson_09_run
+
+// Each generated pipeline has its own header.
+#include "blur_manual.h"
+#include "blur_mullapudi2016.h"
+#include "blur_adams2019.h"
+#include "blur_li2018.h"
+#include "pc_manual.h"
+#include "pc_mullapudi2016.h"
+#include "pc_adams2019.h"
+#include "pc_li2018.h"
+
+// We don't link against libHalide here, so we use the runtime buffer
+// type and the benchmarking helper from the tools directory.
+// 这里不链接libHalide，所以使用运行时的Buffer类型和tools目录下的benchmark工具
+#include "HalideBuffer.h"
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using Halide::Runtime::Buffer;
+using Halide::Tools::benchmark;
+
+// Same sizes as the estimates given to the auto-schedulers.
+static const int kWidth = 3840;
+static const int kHeight = 2160;
+
+struct Variant {
+    const char *name;
+    int (*blur)(halide_buffer_t *, halide_buffer_t *);
+    int (*pc)(halide_buffer_t *);
+};
+
+int main(int argc, char **argv) {
+    // A deterministic synthetic frame, so the lesson doesn't depend on
+    // a 4K image lying around.
+    // 使用确定性的合成图像，不依赖外部的4K图像文件
+    Buffer<uint8_t> input(kWidth, kHeight, 3);
+    fill_synthetic(input);
+
+    Variant variants[] = {
+        {"manual", blur_manual, pc_manual},
+        {"Mullapudi2016", blur_mullapudi2016, pc_mullapudi2016},
+        {"Adams2019", blur_adams2019, pc_adams2019},
+        {"Li2018", blur_li2018, pc_li2018},
+    };
+
+    // The hand-written schedules produce the reference outputs.
+    // 以手写调度的结果作为参考
+    Buffer<uint8_t> blur_reference(kWidth, kHeight, 3);
+    Buffer<float> pc_reference(kWidth, kHeight);
+    blur_manual(input, blur_reference);
+    pc_manual(pc_reference);
+
+    Buffer<uint8_t> blur_output(kWidth, kHeight, 3);
+    Buffer<float> pc_output(kWidth, kHeight);
+
+    printf("%-16s %14s %14s\n", "schedule", "blur (ms)", "prod/cons (ms)");
+    for (const Variant &v : variants) {
+        // Check that the auto-scheduled pipeline computes the same
+        // thing before we bother timing it. The blur is integer math
+        // so it must match exactly. The producer calls sin, which
+        // may be vectorized differently, so allow some slop.
+        // 计时之前先检查结果是否正确
+        if (v.blur(input, blur_output) != 0 || v.pc(pc_output) != 0) {
+            printf("%s: pipeline returned an error\n", v.name);
+            return -1;
+        }
+        for (int c = 0; c < 3; c++) {
+            for (int y = 0; y < kHeight; y++) {
+                for (int x = 0; x < kWidth; x++) {
+                    if (blur_output(x, y, c) != blur_reference(x, y, c)) {
+                        printf("%s: blur_output(%d, %d, %d) = %d instead of %d\n",
+                               v.name, x, y, c, blur_output(x, y, c), blur_reference(x, y, c));
+                        return -1;
+                    }
+                }
+            }
+        }
+        for (int y = 0; y < kHeight; y++) {
+            for (int x = 0; x < kWidth; x++) {
+                float error = pc_output(x, y) - pc_reference(x, y);
+                if (error < -0.001f || error > 0.001f) {
+                    printf("%s: pc_output(%d, %d) = %f instead of %f\n",
+                           v.name, x, y, pc_output(x, y), pc_reference(x, y));
+                    return -1;
+                }
+            }
+        }
+
+        // benchmark() returns the best time in seconds over several
+        // samples, each of which is the average of a few iterations.
+        // benchmark()返回多次采样中最好的一次时间（秒）
+        double blur_time = benchmark(10, 5, [&]() {
+            v.blur(input, blur_output);
+        });
+        double pc_time = benchmark(10, 5, [&]() {
+            v.pc(pc_output);
+        });
+
+        printf("%-16s %14.3f %14.3f\n", v.name, blur_time * 1e3, pc_time * 1e3);
+    }
+
+    // The schedules the auto-schedulers chose are in
+    // blur_*.schedule.h and pc_*.schedule.h. They are ordinary Halide
+    // scheduling calls, so a good one can be pasted into the
+    // Generator's schedule() method and checked in as a hand-written
+    // schedule.
+    // 自动调度器选择的调度保存在blur_*.schedule.h和pc_*.schedule.h中，它们是普通的Halide调度代码，
+    // 可以直接拷贝到Generator的schedule()函数中作为手写调度使用。
+
+    printf("Success!\n");
+    return 0;
+}
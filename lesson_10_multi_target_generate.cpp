@@ -0,0 +1,139 @@
+// Halide tutorial lesson 10: Compiling for several CPUs at once
+// Halide入门教程第十课：多目标编译与运行时CPU分发
+
+// The earlier lessons JIT-compile for whatever machine they happen to
+// be running on, and lesson 8 hard-codes a vector width of four. In
+// this lesson we compile the lesson 7 blur and the lesson 8
+// producer/consumer pipeline ahead of time for three generations of
+// x86 CPU - baseline SSE4.1, AVX2 with FMA, and AVX-512 - and package
+// them into one static library. At runtime the library checks which
+// features the CPU has and runs the best variant it can.
+// 前面几课都是针对当前机器即时编译，第八课中还把向量宽度写死为4。本课将第七课的模糊和第八课的
+// 生产者-消费者流水线提前编译成SSE4.1、AVX2+FMA和AVX-512三个版本，打包到一个静态库里，
+// 运行时根据CPU支持的指令集选择最好的版本。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_10*generate.cpp ../tools/GenGen.cpp -g -std=c++11 -fno-rtti -I ../include -L ../bin -lHalide -lpthread -ldl -o lesson_10_generate
+//
+// A multi-target build is requested by listing several targets,
+// separated by commas. The list is checked at runtime from first to
+// last, and the first one the CPU supports is used, so the most
+// capable target goes first and the baseline goes last.
+// 多目标编译只需要用逗号分隔多个target。运行时从前往后检查，使用第一个CPU支持的target，
+// 所以能力最强的target放在最前面，基础版本放在最后。
+// LD_LIBRARY_PATH=../bin ./lesson_10_generate -g lesson_10_blur -f blur_multi -o . -e static_library,h target=x86-64-linux-sse41-avx-avx2-fma-f16c-avx512-avx512_skylake,x86-64-linux-sse41-avx-avx2-fma-f16c,x86-64-linux-sse41
+// LD_LIBRARY_PATH=../bin ./lesson_10_generate -g lesson_10_producer_consumer -f pc_multi -o . -e static_library,h target=x86-64-linux-sse41-avx-avx2-fma-f16c-avx512-avx512_skylake-no_runtime,x86-64-linux-sse41-avx-avx2-fma-f16c-no_runtime,x86-64-linux-sse41-no_runtime
+//
+// To see what each variant is worth on its own, also build them as
+// separate single-target libraries. The run half of the lesson times
+// each of these that the CPU can execute. Only the multi-target
+// library is needed in production.
+// 为了比较每个版本的性能，再分别编译单目标的库。生产环境中只需要多目标的库。
+// for t in sse41:x86-64-linux-sse41 avx2:x86-64-linux-sse41-avx-avx2-fma-f16c avx512:x86-64-linux-sse41-avx-avx2-fma-f16c-avx512-avx512_skylake; do
+//     LD_LIBRARY_PATH=../bin ./lesson_10_generate -g lesson_10_blur -f blur_${t%%:*} -o . -e static_library,h target=${t#*:}-no_runtime
+//     LD_LIBRARY_PATH=../bin ./lesson_10_generate -g lesson_10_producer_consumer -f pc_${t%%:*} -o . -e static_library,h target=${t#*:}-no_runtime
+// done
+//
+// All of these libraries end up in one program, and it needs exactly
+// one copy of the Halide runtime: each copy brings its own thread
+// pool and its own runtime state. So blur_multi is the only library
+// built with the runtime, and pc_multi (on every target in its list)
+// and all the single-target libraries are built with no_runtime.
+// 这些库最终链接到同一个程序中，而程序中只能有一份Halide运行时：每一份运行时都有自己的线程池和运行时状态。
+// 所以只有blur_multi包含运行时，pc_multi（其target列表中的每一个target）和所有单目标的库都使用no_runtime编译。
+//
+// Then build lesson_10_multi_target_run.cpp as described in that file.
+
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// The clamped blur from lesson 7.
+// 第七课中带边界条件的模糊
+class Lesson10Blur : public Generator<Lesson10Blur> {
+public:
+    Input<Buffer<uint8_t>> input{"input", 3};
+    Output<Buffer<uint8_t>> output{"output", 3};
+
+    void generate() {
+        clamped = BoundaryConditions::repeat_edge(input);
+
+        input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+
+        blur_x(x, y, c) = (input_16(x-1, y, c) +
+                           2 * input_16(x, y, c) +
+                           input_16(x+1, y, c)) / 4;
+
+        blur_y(x, y, c) = (blur_x(x, y-1, c) +
+                           2 * blur_x(x, y, c) +
+                           blur_x(x, y+1, c)) / 4;
+
+        output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+    }
+
+    void schedule() {
+        // The generator is run once per target in the list, and
+        // get_target() returns the one currently being compiled. So
+        // natural_vector_size() is 8 lanes of uint16 for SSE4.1, 16
+        // for AVX2 and 32 for AVX-512, and each variant gets full
+        // width vectors without us writing a separate schedule.
+        // 多目标编译时生成器会针对每个target运行一次，natural_vector_size()返回当前target
+        // 的自然向量宽度，所以每个版本都能使用满宽度的向量，不需要为每个target单独写调度。
+        const int vec = natural_vector_size<uint16_t>();
+
+        Var yo("yo"), yi("yi");
+        output
+            .reorder(x, y, c)
+            .split(y, yo, yi, 32)
+            .parallel(yo)
+            .vectorize(x, vec);
+        blur_x
+            .store_at(output, yo)
+            .compute_at(output, yi)
+            .vectorize(x, vec);
+    }
+
+private:
+    Var x{"x"}, y{"y"}, c{"c"};
+    Func clamped{"clamped"}, input_16{"input_16"};
+    Func blur_x{"blur_x"}, blur_y{"blur_y"};
+};
+
+// The producer/consumer pipeline from lesson 8, with the mixed
+// schedule. This is where lesson 8 wrote vectorize(x, 4).
+// 第八课的生产者-消费者流水线和混合调度，第八课中这里写的是vectorize(x, 4)
+class Lesson10ProducerConsumer : public Generator<Lesson10ProducerConsumer> {
+public:
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        producer(x, y) = sin(x * y);
+        output(x, y) = (producer(x, y) +
+                        producer(x, y+1) +
+                        producer(x+1, y) +
+                        producer(x+1, y+1))/4;
+    }
+
+    void schedule() {
+        // 4 floats for SSE4.1, 8 for AVX2, 16 for AVX-512.
+        const int vec = natural_vector_size<float>();
+
+        Var yo("yo"), yi("yi");
+        output
+            .split(y, yo, yi, 16)
+            .parallel(yo)
+            .vectorize(x, vec);
+        producer
+            .store_at(output, yo)
+            .compute_at(output, yi)
+            .vectorize(x, vec);
+    }
+
+private:
+    Var x{"x"}, y{"y"};
+    Func producer{"producer"};
+};
+
+HALIDE_REGISTER_GENERATOR(Lesson10Blur, lesson_10_blur)
+HALIDE_REGISTER_GENERATOR(Lesson10ProducerConsumer, lesson_10_producer_consumer)
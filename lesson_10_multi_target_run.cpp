@@ -0,0 +1,138 @@
+// Halide tutorial lesson 10: Compiling for several CPUs at once
+// Halide入门教程第十课：多目标编译与运行时CPU分发
+
+// This is the second half of lesson 10. It calls the multi-target
+// libraries produced by lesson_10_multi_target_generate.cpp, which
+// pick a variant on their own, and times them against each
+// single-target variant this CPU can run.
+// 本文件是第十课的第二部分：调用多目标库（运行时自动选择版本），并与当前CPU能运行的
+// 每个单目标版本进行性能比较。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_10*run.cpp blur_multi.a pc_multi.a blur_sse41.a pc_sse41.a blur_avx2.a pc_avx2.a blur_avx512.a pc_avx512.a -g -std=c++11 -I ../include -I ../tools -I . -lpthread -ldl -o lesson_10_run
+// ./lesson_10_run
+
+#include "blur_multi.h"
+#include "blur_sse41.h"
+#include "blur_avx2.h"
+#include "blur_avx512.h"
+#include "pc_multi.h"
+#include "pc_sse41.h"
+#include "pc_avx2.h"
+#include "pc_avx512.h"
+
+#include "HalideBuffer.h"
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+#include <stdio.h>
+
+using Halide::Runtime::Buffer;
+using Halide::Tools::benchmark;
+
+struct Variant {
+    const char *name;
+    // Whether this CPU can run the variant. We ask the compiler's
+    // cpuid wrapper; the multi-target library asks the Halide runtime,
+    // which checks the same cpuid bits.
+    // 当前CPU能否运行该版本。这里用编译器提供的cpuid接口判断，
+    // 多目标库内部使用Halide运行时检查同样的cpuid位。
+    bool supported;
+    int (*blur)(halide_buffer_t *, halide_buffer_t *);
+    int (*pc)(halide_buffer_t *);
+};
+
+int main(int argc, char **argv) {
+    const int width = 3840, height = 2160;
+
+    Buffer<uint8_t> input(width, height, 3);
+    fill_synthetic(input);
+    Buffer<uint8_t> blur_output(width, height, 3);
+    Buffer<float> pc_output(width, height);
+
+    __builtin_cpu_init();
+    bool has_sse41 = __builtin_cpu_supports("sse4.1");
+    bool has_avx2 = has_sse41 &&
+                    __builtin_cpu_supports("avx2") &&
+                    __builtin_cpu_supports("fma");
+    bool has_avx512 = has_avx2 &&
+                      __builtin_cpu_supports("avx512f") &&
+                      __builtin_cpu_supports("avx512bw") &&
+                      __builtin_cpu_supports("avx512dq") &&
+                      __builtin_cpu_supports("avx512vl") &&
+                      __builtin_cpu_supports("avx512cd");
+
+    // This mirrors the order of the target list in the generator: the
+    // first supported target wins.
+    // 与生成器中target列表的顺序一致：第一个被支持的target胜出
+    printf("The multi-target library will run the %s variant on this CPU\n",
+           has_avx512 ? "AVX-512" : has_avx2 ? "AVX2+FMA" : "SSE4.1");
+
+    Variant variants[] = {
+        {"multi-target", true, blur_multi, pc_multi},
+        {"sse41", has_sse41, blur_sse41, pc_sse41},
+        {"avx2+fma", has_avx2, blur_avx2, pc_avx2},
+        {"avx512", has_avx512, blur_avx512, pc_avx512},
+    };
+
+    // Every variant must compute the same blur. The producer uses
+    // sin, whose vectorized approximation may differ in the last few
+    // bits between instruction sets, so we compare it loosely.
+    // 各个版本的模糊结果必须完全一致，sin在不同指令集下可能有末位误差，所以比较时留有余量。
+    Buffer<uint8_t> blur_reference(width, height, 3);
+    Buffer<float> pc_reference(width, height);
+    if (blur_multi(input, blur_reference) != 0 || pc_multi(pc_reference) != 0) {
+        printf("multi-target: pipeline returned an error\n");
+        return -1;
+    }
+
+    printf("%-14s %14s %14s\n", "variant", "blur (ms)", "prod/cons (ms)");
+    for (const Variant &v : variants) {
+        if (!v.supported) {
+            printf("%-14s %14s %14s\n", v.name, "n/a", "n/a");
+            continue;
+        }
+
+        if (v.blur(input, blur_output) != 0 || v.pc(pc_output) != 0) {
+            printf("%s: pipeline returned an error\n", v.name);
+            return -1;
+        }
+        for (int c = 0; c < 3; c++) {
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    if (blur_output(x, y, c) != blur_reference(x, y, c)) {
+                        printf("%s: blur_output(%d, %d, %d) = %d instead of %d\n",
+                               v.name, x, y, c, blur_output(x, y, c), blur_reference(x, y, c));
+                        return -1;
+                    }
+                }
+            }
+        }
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float error = pc_output(x, y) - pc_reference(x, y);
+                if (error < -0.001f || error > 0.001f) {
+                    printf("%s: pc_output(%d, %d) = %f instead of %f\n",
+                           v.name, x, y, pc_output(x, y), pc_reference(x, y));
+                    return -1;
+                }
+            }
+        }
+
+        double blur_time = benchmark(10, 5, [&]() {
+            v.blur(input, blur_output);
+        });
+        double pc_time = benchmark(10, 5, [&]() {
+            v.pc(pc_output);
+        });
+        printf("%-14s %14.3f %14.3f\n", v.name, blur_time * 1e3, pc_time * 1e3);
+    }
+
+    // The multi-target row should match the fastest supported
+    // single-target row, plus a one-time feature check on the first
+    // call.
+    // 多目标版本的时间应当与最快的单目标版本一致，只在第一次调用时多一次特性检查。
+
+    printf("Success!\n");
+    return 0;
+}
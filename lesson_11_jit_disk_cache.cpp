@@ -0,0 +1,338 @@
+// Halide tutorial lesson 11: Keeping compiled pipelines on disk between runs
+// Halide入门教程第十一课：在磁盘上缓存编译好的流水线
+
+// Every time one of the earlier lessons runs, realize() lowers the
+// pipeline, hands it to LLVM and JIT-compiles it, even though the
+// pipeline and its schedule are the same as last time. For short-lived
+// processes that compile is most of the runtime. This lesson keeps the
+// compiled code in a directory on local disk, keyed by everything that
+// affects the generated code, and loads it on later runs.
+// 前面几课每次运行时，realize()都会重新lower流水线并交给LLVM即时编译，即使流水线和调度
+// 与上次完全相同。对于短生命周期的进程，编译时间占了大部分。本课把编译好的代码缓存到本地磁盘，
+// 以所有影响生成代码的信息作为键，下次运行时直接加载。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_11*.cpp -g -std=c++11 -I ../include -L ../bin -lHalide -lpthread -ldl -o lesson_11
+// LD_LIBRARY_PATH=../bin ./lesson_11
+// Run it twice: the second run should find everything in the cache.
+// 运行两次：第二次运行时应该全部命中缓存。
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+
+// Bump this whenever the layout of the cache directory or the way
+// keys are built changes, so old entries are never misread.
+// 缓存目录布局或键的构造方式改变时增加该版本号，保证旧的缓存项不会被误用。
+static const char *kCacheFormat = "lesson_11_cache_v1";
+
+static std::string read_file(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    std::stringstream s;
+    s << f.rdbuf();
+    return s.str();
+}
+
+// 64-bit FNV-1a. It only picks the file name; the full key is stored
+// next to each entry and compared on load, so a collision costs a
+// recompile, never a wrong answer.
+// 哈希值只用于确定文件名，完整的键保存在缓存项旁边，加载时逐字节比较，
+// 所以哈希冲突只会导致重新编译，不会得到错误结果。
+static uint64_t fnv1a(const std::string &s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char ch : s) {
+        h ^= ch;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+class DiskCachedPipeline {
+public:
+    // The entry point Halide emits alongside every compiled pipeline.
+    // It takes an array of pointers: halide_buffer_t* for buffers, and
+    // a pointer to the value for scalars, inputs first, then outputs.
+    // Halide为每个编译好的流水线生成的_argv入口：参数是指针数组，buffer传halide_buffer_t*，
+    // 标量传指向值的指针，先输入后输出。
+    typedef int (*ArgvFunc)(void **);
+
+    DiskCachedPipeline(Pipeline p, const std::string &name, const std::string &cache_dir)
+        : pipeline(p), name(name), cache_dir(cache_dir) {
+    }
+
+    ~DiskCachedPipeline() {
+        if (handle) dlclose(handle);
+    }
+
+    // Make sure a compiled version is loaded, compiling it if the
+    // cache has no valid entry. Returns true on a cache hit.
+    // 确保编译好的版本已加载，缓存中没有有效项时进行编译。命中缓存时返回true。
+    bool load(const Target &jit_target = get_jit_target_from_environment()) {
+        // A JIT target leaves the Halide runtime out of the object,
+        // expecting to share the one in libHalide. Our .so has to
+        // stand on its own, so it gets its own copy of the runtime.
+        // JIT target生成的目标文件不包含Halide运行时，而是使用libHalide中共享的运行时。我们的.so必须能
+        // 独立加载，所以要去掉JIT特性，让它包含自己的运行时。
+        Target target = jit_target.without_feature(Target::JIT);
+        args = pipeline.infer_arguments();
+        std::string key = make_key(target);
+
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)fnv1a(key));
+        std::string base = cache_dir + "/" + name + "-" + hash;
+        std::string so_path = base + ".so";
+        std::string key_path = base + ".key";
+
+        // An entry is only valid if its key matches ours exactly. The
+        // key file is written last, so a half-written entry from a
+        // crashed process is never considered valid.
+        // 只有键完全相同的缓存项才有效。键文件最后写入，所以崩溃进程留下的不完整缓存项不会被使用。
+        bool hit = access(so_path.c_str(), R_OK) == 0 &&
+                   access(key_path.c_str(), R_OK) == 0 &&
+                   read_file(key_path) == key;
+
+        if (!hit) {
+            compile(target, so_path, key_path, key);
+        }
+
+        handle = dlopen(so_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            fprintf(stderr, "dlopen(%s) failed: %s\n", so_path.c_str(), dlerror());
+            exit(-1);
+        }
+        entry = (ArgvFunc)dlsym(handle, (name + "_argv").c_str());
+        if (!entry) {
+            fprintf(stderr, "%s_argv not found in %s\n", name.c_str(), so_path.c_str());
+            exit(-1);
+        }
+        return hit;
+    }
+
+    // Run the pipeline. 'argv' follows the _argv convention above.
+    int run(std::vector<void *> argv) {
+        return entry(argv.data());
+    }
+
+    const std::vector<Argument> &arguments() const {
+        return args;
+    }
+
+private:
+    // Everything that changes the generated code goes into the key.
+    // The lowered statement covers the algorithm and the schedule:
+    // every split, reorder, compute_at and vectorize shows up in it.
+    // The target covers the instruction set and feature flags, and the
+    // argument list covers the parameter names and types, which change
+    // the calling convention even when the loops don't.
+    // 所有影响生成代码的信息都放到键里。lower之后的语句包含了算法和调度，每个split、reorder、
+    // compute_at和vectorize都体现在其中。target包含指令集和特性，参数列表包含参数名和类型。
+    std::string make_key(const Target &target) {
+        std::ostringstream key;
+        key << kCacheFormat << "\n";
+#ifdef HALIDE_VERSION_MAJOR
+        key << "halide " << HALIDE_VERSION_MAJOR << "."
+            << HALIDE_VERSION_MINOR << "." << HALIDE_VERSION_PATCH << "\n";
+#endif
+        key << "name " << name << "\n";
+        key << "target " << target.to_string() << "\n";
+        for (const Argument &a : args) {
+            key << "arg " << a.name
+                << " kind " << (int)a.kind
+                << " type " << (int)a.type.code() << ":" << a.type.bits() << ":" << a.type.lanes()
+                << " dims " << (int)a.dimensions << "\n";
+        }
+
+        // Lowering is much cheaper than code generation, which is
+        // what we're trying to skip. We lower into a temporary file
+        // and hash its contents.
+        // lower的开销远小于代码生成，我们要省掉的是后者。
+        std::string stmt_path = cache_dir + "/." + name + "." + std::to_string(getpid()) + ".stmt";
+        pipeline.compile_to_lowered_stmt(stmt_path, args, Text, target);
+        key << read_file(stmt_path);
+        unlink(stmt_path.c_str());
+        return key.str();
+    }
+
+    void compile(const Target &target, const std::string &so_path,
+                 const std::string &key_path, const std::string &key) {
+        // Build under temporary names and rename into place, so that
+        // concurrent processes sharing the cache only ever see
+        // complete files. rename() is atomic within a file system.
+        // 先用临时文件名生成，再重命名，使共享缓存的并发进程只能看到完整的文件。
+        std::string tmp = so_path + "." + std::to_string(getpid());
+        std::string obj = tmp + ".o";
+
+        pipeline.compile_to_object(obj, args, name, target);
+
+        std::string link = "cc -shared -o " + tmp + ".so " + obj + " -lpthread -ldl -lm";
+        if (system(link.c_str()) != 0) {
+            fprintf(stderr, "Failed to link %s\n", obj.c_str());
+            exit(-1);
+        }
+        unlink(obj.c_str());
+
+        {
+            std::ofstream f(tmp + ".key", std::ios::binary);
+            f << key;
+        }
+        // The key goes in only after the library, so a key file never
+        // vouches for a library that didn't make it into place.
+        // 键文件在库文件之后才放到位，所以键文件永远不会对应一个没有放到位的库文件。
+        if (rename((tmp + ".so").c_str(), so_path.c_str()) != 0) {
+            fprintf(stderr, "Failed to move %s.so into place: %s\n", tmp.c_str(), strerror(errno));
+            unlink((tmp + ".so").c_str());
+            unlink((tmp + ".key").c_str());
+            unlink(key_path.c_str());
+            exit(-1);
+        }
+        if (rename((tmp + ".key").c_str(), key_path.c_str()) != 0) {
+            fprintf(stderr, "Failed to move %s.key into place: %s\n", tmp.c_str(), strerror(errno));
+            unlink((tmp + ".key").c_str());
+            unlink(key_path.c_str());
+            exit(-1);
+        }
+    }
+
+    Pipeline pipeline;
+    std::string name, cache_dir;
+    std::vector<Argument> args;
+    void *handle = nullptr;
+    ArgvFunc entry = nullptr;
+};
+
+static double ms_since(std::chrono::high_resolution_clock::time_point t) {
+    auto d = std::chrono::high_resolution_clock::now() - t;
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+int main(int argc, char **argv) {
+    // The cache lives in $HL_JIT_CACHE_DIR, or a directory under /tmp.
+    // 缓存目录为$HL_JIT_CACHE_DIR，默认在/tmp下。
+    const char *dir_env = getenv("HL_JIT_CACHE_DIR");
+    std::string cache_dir = dir_env ? dir_env : "/tmp/halide_lesson_11_cache";
+    mkdir(cache_dir.c_str(), 0755);
+
+    Var x("x"), y("y"), c("c");
+
+    // The clamped blur from lesson 7. This time the input is an
+    // ImageParam, so the compiled code works for any image.
+    // 第七课中带边界条件的模糊，这次输入是ImageParam，编译好的代码可以处理任何图像。
+    ImageParam input(UInt(8), 3, "input");
+    Func clamped("clamped");
+    clamped = BoundaryConditions::repeat_edge(input);
+    Func input_16("input_16");
+    input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+    Func blur_x("blur_x");
+    blur_x(x, y, c) = (input_16(x-1, y, c) +
+                       2 * input_16(x, y, c) +
+                       input_16(x+1, y, c)) / 4;
+    Func blur_y("blur_y");
+    blur_y(x, y, c) = (blur_x(x, y-1, c) +
+                       2 * blur_x(x, y, c) +
+                       blur_x(x, y+1, c)) / 4;
+    Func blur("blur");
+    blur(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+
+    Var yo("yo"), yi("yi");
+    blur.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, 16);
+    blur_x.store_at(blur, yo).compute_at(blur, yi).vectorize(x, 16);
+
+    // The mixed schedule from lesson 8.
+    // 第八课中的混合调度
+    Func producer("producer"), consumer("consumer");
+    producer(x, y) = sin(x * y);
+    consumer(x, y) = (producer(x, y) +
+                      producer(x, y+1) +
+                      producer(x+1, y) +
+                      producer(x+1, y+1))/4;
+    consumer.split(y, yo, yi, 16).parallel(yo).vectorize(x, 4);
+    producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, 4);
+
+    // First the usual way, for comparison. compile_jit() is the step
+    // realize() does implicitly the first time it is called.
+    // 先用常规方式编译作为对比，compile_jit()就是realize()第一次调用时隐式执行的步骤。
+    auto t0 = std::chrono::high_resolution_clock::now();
+    blur.compile_jit();
+    consumer.compile_jit();
+    printf("JIT compile of both pipelines: %.1f ms\n", ms_since(t0));
+
+    // Now through the disk cache.
+    t0 = std::chrono::high_resolution_clock::now();
+    DiskCachedPipeline cached_blur(blur, "lesson_11_blur", cache_dir);
+    DiskCachedPipeline cached_consumer(consumer, "lesson_11_consumer", cache_dir);
+    bool blur_hit = cached_blur.load();
+    bool consumer_hit = cached_consumer.load();
+    printf("Disk cache load of both pipelines: %.1f ms (blur: %s, consumer: %s)\n",
+           ms_since(t0),
+           blur_hit ? "hit" : "miss",
+           consumer_hit ? "hit" : "miss");
+
+    // Check the cached code against the JIT-compiled code. The blur
+    // takes the input buffer then the output buffer; the consumer
+    // only takes its output.
+    // 比较缓存代码与即时编译代码的结果。
+    Buffer<uint8_t> image(1920, 1080, 3);
+    fill_synthetic(image);
+    input.set(image);
+    Buffer<uint8_t> jit_blur = blur.realize(image.width(), image.height(), 3);
+    Buffer<uint8_t> cached_blur_out(image.width(), image.height(), 3);
+    if (cached_blur.run({image.raw_buffer(), cached_blur_out.raw_buffer()}) != 0) {
+        printf("Cached blur failed\n");
+        return -1;
+    }
+
+    Buffer<float> jit_consumer = consumer.realize(160, 160);
+    Buffer<float> cached_consumer_out(160, 160);
+    if (cached_consumer.run({cached_consumer_out.raw_buffer()}) != 0) {
+        printf("Cached consumer failed\n");
+        return -1;
+    }
+
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < image.height(); y++) {
+            for (int x = 0; x < image.width(); x++) {
+                if (jit_blur(x, y, c) != cached_blur_out(x, y, c)) {
+                    printf("cached_blur_out(%d, %d, %d) = %d instead of %d\n",
+                           x, y, c, cached_blur_out(x, y, c), jit_blur(x, y, c));
+                    return -1;
+                }
+            }
+        }
+    }
+    for (int y = 0; y < 160; y++) {
+        for (int x = 0; x < 160; x++) {
+            if (jit_consumer(x, y) != cached_consumer_out(x, y)) {
+                printf("cached_consumer_out(%d, %d) = %f instead of %f\n",
+                       x, y, cached_consumer_out(x, y), jit_consumer(x, y));
+                return -1;
+            }
+        }
+    }
+
+    // Try changing the split factor of the blur above and running
+    // again. The lowered statement changes, so the key changes, and
+    // the old entry is left alone while a new one is compiled. The
+    // same happens if HL_JIT_TARGET selects a different target.
+    // Stale entries can be removed by deleting the directory.
+    // 试着修改上面模糊的split因子后再次运行，lower之后的语句改变，键也随之改变，旧的缓存项保持不变，
+    // 重新编译一个新的缓存项。用HL_JIT_TARGET选择不同的target也是一样。删除缓存目录即可清除旧的缓存项。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,213 @@
+// Halide tutorial lesson 12: Running the producer ahead of the consumer on another core
+// Halide入门教程第十二课：在另一个核上异步运行生产者
+
+// In lesson 8, producer.store_root().compute_at(consumer, y)
+// interleaves the two stages on one thread: compute a scanline of the
+// producer, then a scanline of the consumer, then the next scanline
+// of the producer, and so on. When the producer is expensive the
+// consumer spends most of its time waiting for it. This lesson
+// schedules the producer asynchronously, so it runs ahead on a
+// second thread and fills a small circular buffer that the consumer
+// drains.
+// 第八课中producer.store_root().compute_at(consumer, y)让两个阶段在同一个线程上交替执行。
+// 当生产者计算代价较高时，消费者大部分时间在等待。本课把生产者调度为异步执行，它在另一个线程上
+// 提前运行，往一个小的循环buffer里写数据，消费者从中读取。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_12*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_12
+// LD_LIBRARY_PATH=../bin ./lesson_12
+
+#include "Halide.h"
+#include <stdio.h>
+
+// A header from the tools directory for timing pipelines.
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// Build the producer/consumer pipeline from lesson 8. 'cost' extra
+// terms are added to the producer so we can make it as expensive as a
+// real pipeline stage; cost = 0 is exactly the lesson 8 producer.
+// 构造第八课中的生产者-消费者流水线。'cost'控制给生产者额外增加的计算量，cost = 0时
+// 与第八课的生产者完全相同。
+struct CostlyProducerConsumer {
+    Func producer, consumer;
+    Var x, y;
+
+    CostlyProducerConsumer(const std::string &name, int cost)
+        : producer("producer_" + name), consumer("consumer_" + name), x("x"), y("y") {
+        Expr value = sin(x * y);
+        for (int i = 1; i <= cost; i++) {
+            value += sin(value * i + x) * cos(value - i * y);
+        }
+        producer(x, y) = value;
+        consumer(x, y) = (producer(x, y) +
+                          producer(x, y+1) +
+                          producer(x+1, y) +
+                          producer(x+1, y+1))/4;
+    }
+};
+
+int main(int argc, char **argv) {
+    // First, the schedule on its own on a small box, with tracing, so
+    // we can see what async does.
+    // 首先在一个小区域上打开跟踪，观察async的效果
+    {
+        CostlyProducerConsumer p("async_traced", 0);
+
+        // store_root().compute_at(consumer, y) is the lesson 8
+        // schedule. async() moves the producer onto its own thread.
+        // The producer and consumer then synchronize through
+        // semaphores: the producer signals each time a scanline is
+        // ready, and the consumer signals each time it has finished
+        // with one, so the producer can reuse that slot.
+        // store_root().compute_at(consumer, y)就是第八课的调度，async()把生产者放到单独的线程中。
+        // 生产者和消费者通过信号量同步：生产者每算完一行就发出信号，消费者每用完一行也发出信号，
+        // 这样生产者就可以重用这一行的存储空间。
+        //
+        // fold_storage(y, 4) bounds the producer's storage to a
+        // circular buffer of four scanlines. Without async, Halide
+        // folds this down to two scanlines on its own, as we saw in
+        // lesson 8. With async we say how far ahead the producer may
+        // run: with four slots it can be up to two scanlines ahead of
+        // the two the consumer is reading.
+        // fold_storage(y, 4)把生产者的存储限制为4行的循环buffer。没有async时，Halide会自动折叠成
+        // 两行。有async时需要我们指定生产者能提前多少：4行的空间让生产者最多可以比消费者正在读的
+        // 两行提前两行。
+        p.producer
+            .store_root()
+            .fold_storage(p.y, 4)
+            .compute_at(p.consumer, p.y)
+            .async();
+
+        p.producer.trace_stores();
+        p.consumer.trace_stores();
+
+        printf("\nEvaluating producer.store_root().fold_storage(y, 4)"
+               ".compute_at(consumer, y).async()\n");
+        p.consumer.realize(4, 4);
+
+        // The trace now shows producer scanlines running ahead of the
+        // consumer, and the two sets of stores interleave
+        // differently from run to run, because they happen on
+        // different threads.
+        // 跟踪结果显示生产者的行先于消费者计算，由于运行在不同的线程上，每次运行的交错顺序都可能不同。
+
+        printf("Pseudo-code for the schedule:\n");
+        p.consumer.print_loop_nest();
+        printf("\n");
+
+        // The loop nest shows the producer and consumer as two
+        // branches of a 'fork'. Equivalent C looks something like:
+        //
+        // float producer_storage[4][5];
+        // semaphore space(4), ready(0);
+        // fork {
+        //     for (int y = 0; y < 5; y++) {
+        //         acquire(space);
+        //         for (int x = 0; x < 5; x++)
+        //             producer_storage[y & 3][x] = sin(x * y);
+        //         release(ready);
+        //     }
+        // } and {
+        //     acquire(ready);   // scanline 0
+        //     for (int y = 0; y < 4; y++) {
+        //         acquire(ready);   // scanline y + 1
+        //         for (int x = 0; x < 4; x++)
+        //             result[y][x] = (producer_storage[y & 3][x] + ...)/4;
+        //         release(space);   // done with scanline y
+        //     }
+        // }
+    }
+
+    // Now let's time it. We compare three schedules for a cheap and an
+    // expensive producer, over the 160x160 problem from lesson 8 and
+    // two larger ones:
+    // 1) store_root().compute_at(consumer, y), as in lesson 8.
+    // 2) the same thing, vectorized.
+    // 3) the vectorized version with the producer made async.
+    // 接下来计时。对于低代价和高代价的生产者，在第八课的160x160和更大的问题上比较三个调度：
+    // 1) 第八课的store_root().compute_at(consumer, y)
+    // 2) 同上，加上向量化
+    // 3) 向量化，并且生产者异步执行
+    const int sizes[] = {160, 1024, 4096};
+    const int costs[] = {0, 8};
+
+    printf("%-6s %-6s %14s %14s %14s %8s\n",
+           "size", "cost", "sync (ms)", "sync+vec (ms)", "async (ms)", "speedup");
+
+    for (int cost : costs) {
+        for (int size : sizes) {
+            CostlyProducerConsumer sync("sync", cost);
+            sync.producer.store_root().compute_at(sync.consumer, sync.y);
+
+            CostlyProducerConsumer vec("vec", cost);
+            vec.consumer.vectorize(vec.x, 8);
+            vec.producer
+                .store_root()
+                .compute_at(vec.consumer, vec.y)
+                .vectorize(vec.x, 8);
+
+            CostlyProducerConsumer async("async", cost);
+            async.consumer.vectorize(async.x, 8);
+            async.producer
+                .store_root()
+                .fold_storage(async.y, 8)
+                .compute_at(async.consumer, async.y)
+                .vectorize(async.x, 8)
+                .async();
+
+            // Compile outside of the timing loop.
+            sync.consumer.compile_jit();
+            vec.consumer.compile_jit();
+            async.consumer.compile_jit();
+
+            Buffer<float> sync_result(size, size), vec_result(size, size), async_result(size, size);
+
+            double sync_time = benchmark(5, 5, [&]() { sync.consumer.realize(sync_result); });
+            double vec_time = benchmark(5, 5, [&]() { vec.consumer.realize(vec_result); });
+            double async_time = benchmark(5, 5, [&]() { async.consumer.realize(async_result); });
+
+            // The async schedule must compute the same values as the
+            // sync one. sin may be vectorized slightly differently, so
+            // allow some slop like lesson 8 does.
+            // 异步调度的结果必须与同步调度一致，允许少量浮点误差。
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    float error = async_result(x, y) - sync_result(x, y);
+                    if (error < -0.001f || error > 0.001f) {
+                        printf("async_result(%d, %d) = %f instead of %f\n",
+                               x, y, async_result(x, y), sync_result(x, y));
+                        return -1;
+                    }
+                }
+            }
+
+            printf("%-6d %-6d %14.3f %14.3f %14.3f %7.2fx\n",
+                   size, cost, sync_time * 1e3, vec_time * 1e3, async_time * 1e3,
+                   vec_time / async_time);
+        }
+    }
+
+    // With the cheap producer, async doesn't buy much: both stages are
+    // quick, and the semaphore traffic per scanline eats most of what
+    // the second core saves. With the expensive producer, the
+    // consumer no longer waits for it, and the time approaches that of
+    // the slower of the two stages instead of their sum. At 160x160
+    // there are only 160 scanlines, so the cost of starting the second
+    // thread is still visible.
+    //
+    // Note that this schedule keeps both stages serial in y. For large
+    // images the lesson 8 mixed schedule, which parallelizes over
+    // strips, will use all the cores; async is for pipelines that
+    // can't be split into independent strips, or for overlapping an
+    // expensive stage with the rest of a parallel pipeline.
+    // 对于低代价的生产者，async的收益不大：每行的信号量同步开销抵消了第二个核带来的好处。对于高代价的
+    // 生产者，消费者不再等待，总时间接近两个阶段中较慢的那个，而不是两者之和。
+    // 注意这个调度在y方向上仍然是串行的。对于大图像，第八课中按条带并行的混合调度可以用满所有的核；
+    // async适用于无法拆分成独立条带的流水线，或者用来把一个高代价的阶段与其余并行部分重叠执行。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,439 @@
+// Halide tutorial lesson 13: Simulating the cache behaviour of a schedule
+// Halide入门教程第十三课：通过跟踪访存模拟调度的缓存行为
+
+// Lesson 8 argues about schedules in terms of locality: "compute_at
+// gives better locality", "we load values soon after they are
+// stored". This lesson checks those claims. We trace every load and
+// store of the lesson 8 schedules at a realistic size, turn the
+// traced coordinates back into addresses, and replay them through a
+// simple model of an L1/L2/LLC cache hierarchy. For each Func we
+// report the miss rate at each level and a histogram of reuse
+// distances.
+// 第八课用局部性来解释调度的好坏，例如"compute_at的局部性更好"。本课验证这些说法：在较大的图像上
+// 跟踪第八课各个调度的每一次load和store，把坐标转换回地址，在一个简单的L1/L2/LLC缓存模型中回放，
+// 报告每个Func在每一级缓存的缺失率以及重用距离的分布。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_13*.cpp -g -std=c++11 -I ../include -L ../bin -lHalide -lpthread -ldl -o lesson_13
+// LD_LIBRARY_PATH=../bin ./lesson_13 [size] [l1_kb] [l2_kb] [llc_kb]
+// The defaults are a 512x512 image, a 32KB L1, a 1MB L2 and a 32MB LLC.
+// 默认参数为512x512的图像，32KB的L1，1MB的L2和32MB的LLC。
+
+// Keep in mind what the model leaves out. Trace events carry the
+// logical coordinates of each access, so storage that Halide folds
+// into a circular buffer is modelled unfolded; the real footprint of
+// the store_root schedules is smaller than what we simulate. Values
+// Halide keeps in registers aren't traced at all. And the model has
+// no prefetchers, so streaming access patterns look worse than they
+// are on real hardware. It tells you about the shape of the access
+// stream, not exact counts.
+// 注意模型忽略了一些因素：跟踪事件中只有逻辑坐标，所以被Halide折叠成循环buffer的存储在模型中没有折叠，
+// store_root调度实际占用的内存比模拟的更小；寄存器中的值不会被跟踪；模型中没有硬件预取。
+// 所以模拟结果反映的是访存序列的形态，而不是精确的计数。
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Halide;
+
+static const int kLineBytes = 64;
+
+// One level of a set-associative LRU cache.
+// 一级组相联LRU缓存
+class CacheLevel {
+public:
+    CacheLevel(const char *name, int64_t size_bytes, int ways)
+        : name(name), ways(ways) {
+        sets = (int)(size_bytes / kLineBytes / ways);
+        if (sets < 1) sets = 1;
+        tags.assign((size_t)sets * ways, -1);
+        stamps.assign((size_t)sets * ways, 0);
+    }
+
+    // Returns true on a hit. On a miss the line is filled, evicting
+    // the least recently used line in its set.
+    // 命中时返回true；缺失时填充该行，替换组内最近最少使用的行。
+    bool access(int64_t line) {
+        now++;
+        int64_t *set_tags = &tags[(size_t)(line % sets) * ways];
+        uint64_t *set_stamps = &stamps[(size_t)(line % sets) * ways];
+        int victim = 0;
+        for (int w = 0; w < ways; w++) {
+            if (set_tags[w] == line) {
+                set_stamps[w] = now;
+                return true;
+            }
+            if (set_stamps[w] < set_stamps[victim]) victim = w;
+        }
+        set_tags[victim] = line;
+        set_stamps[victim] = now;
+        return false;
+    }
+
+    const char *name;
+
+private:
+    int sets, ways;
+    std::vector<int64_t> tags;
+    std::vector<uint64_t> stamps;
+    uint64_t now = 0;
+};
+
+// What we record for each traced access: the cache line and which
+// Func it belongs to.
+struct Access {
+    int64_t line;
+    int func;
+};
+
+// The region of the simulated address space holding one realization
+// of a Func.
+// 一次Func realization在模拟地址空间中占用的区域
+struct Allocation {
+    int64_t base, bytes;
+    std::vector<int> min, extent;
+};
+
+struct Recorder {
+    std::mutex lock;
+    std::vector<Access> accesses;
+    std::vector<std::string> func_names;
+    std::map<std::string, int> func_ids;
+
+    // Live allocations, by the id we handed out at begin_realization.
+    std::map<int, Allocation> allocations;
+    // The most recent allocation of each Func, which is where its
+    // loads and stores go.
+    std::map<std::string, int> current;
+    // Freed blocks, by size. Like malloc, we hand the same block back
+    // out when a Func of the same size is realized again, e.g. once
+    // per tile.
+    // 已释放的块，按大小索引。与malloc类似，当同样大小的Func再次realize时（例如每个tile一次）
+    // 重用同一块地址。
+    std::multimap<int64_t, int64_t> free_blocks;
+    int64_t top = 0;
+    int next_id = 1;
+
+    int func_id(const std::string &name) {
+        auto it = func_ids.find(name);
+        if (it != func_ids.end()) return it->second;
+        int id = (int)func_names.size();
+        func_names.push_back(name);
+        func_ids[name] = id;
+        return id;
+    }
+
+    int allocate(const std::string &name, const std::vector<int> &min,
+                 const std::vector<int> &extent, int elem_bytes) {
+        Allocation a;
+        a.min = min;
+        a.extent = extent;
+        a.bytes = elem_bytes;
+        for (int e : extent) a.bytes *= e;
+        auto it = free_blocks.find(a.bytes);
+        if (it != free_blocks.end()) {
+            a.base = it->second;
+            free_blocks.erase(it);
+        } else {
+            // Line-aligned, like Halide's own allocations.
+            a.base = top;
+            top += (a.bytes + kLineBytes - 1) / kLineBytes * kLineBytes;
+        }
+        int id = next_id++;
+        allocations[id] = a;
+        current[name] = id;
+        return id;
+    }
+
+    void release(int id) {
+        auto it = allocations.find(id);
+        if (it == allocations.end()) return;
+        free_blocks.insert({it->second.bytes, it->second.base});
+        allocations.erase(it);
+    }
+
+    void reset() {
+        accesses.clear();
+        allocations.clear();
+        current.clear();
+        free_blocks.clear();
+        top = 0;
+    }
+};
+
+static Recorder recorder;
+
+// The custom trace handler. Halide calls this for every traced event
+// instead of printing it.
+// 自定义跟踪处理函数，Halide对每个跟踪事件调用它，而不是打印出来。
+int record_trace(void *user_context, const halide_trace_event_t *e) {
+    std::lock_guard<std::mutex> guard(recorder.lock);
+    std::string name = e->func;
+
+    switch (e->event) {
+    case halide_trace_begin_realization: {
+        // The coordinates of a begin_realization event are
+        // (min, extent) pairs, one per dimension.
+        // begin_realization事件的坐标是每个维度的(min, extent)对
+        std::vector<int> min, extent;
+        for (int d = 0; d + 1 < e->dimensions; d += 2) {
+            min.push_back(e->coordinates[d]);
+            extent.push_back(e->coordinates[d + 1]);
+        }
+        return recorder.allocate(name, min, extent, e->type.bytes());
+    }
+    case halide_trace_end_realization:
+        recorder.release(e->parent_id);
+        return 0;
+    case halide_trace_load:
+    case halide_trace_store: {
+        auto cur = recorder.current.find(name);
+        if (cur == recorder.current.end()) return 0;
+        auto alloc = recorder.allocations.find(cur->second);
+        if (alloc == recorder.allocations.end()) return 0;
+        const Allocation &a = alloc->second;
+        int func = recorder.func_id(name);
+
+        // For vector accesses the coordinates are one vector per
+        // dimension. Record each cache line the vector touches once.
+        // 向量访问的坐标是每个维度一个向量，向量访问涉及的每个缓存行只记录一次。
+        int lanes = e->type.lanes;
+        int dims = e->dimensions / lanes;
+        int64_t last_line = -1;
+        for (int lane = 0; lane < lanes; lane++) {
+            int64_t index = 0, stride = 1;
+            for (int d = 0; d < dims && d < (int)a.min.size(); d++) {
+                index += (e->coordinates[d * lanes + lane] - a.min[d]) * stride;
+                stride *= a.extent[d];
+            }
+            int64_t line = (a.base + index * e->type.bytes()) / kLineBytes;
+            if (line != last_line) {
+                recorder.accesses.push_back({line, func});
+                last_line = line;
+            }
+        }
+        return 0;
+    }
+    default:
+        // Produce/consume and pipeline events need a unique id too.
+        return recorder.next_id++;
+    }
+}
+
+// A Fenwick tree over access times, used to compute exact reuse
+// (LRU stack) distances in O(n log n): the reuse distance of an access
+// is the number of distinct lines touched since the previous access
+// to the same line.
+// 基于访问时间的树状数组，用O(n log n)的时间计算精确的重用距离（LRU栈距离）：
+// 一次访问的重用距离是距上一次访问同一行之间访问过的不同行的数量。
+class Fenwick {
+public:
+    explicit Fenwick(size_t n) : tree(n + 1, 0) {}
+    void add(size_t i, int v) {
+        for (i++; i < tree.size(); i += i & (~i + 1)) tree[i] += v;
+    }
+    int64_t prefix(size_t i) const {
+        int64_t s = 0;
+        for (i++; i > 0; i -= i & (~i + 1)) s += tree[i];
+        return s;
+    }
+
+private:
+    std::vector<int64_t> tree;
+};
+
+struct FuncStats {
+    int64_t accesses = 0;
+    int64_t misses[3] = {0, 0, 0};
+    // Reuse distances in power-of-two buckets, in cache lines. The
+    // last bucket counts first touches (infinite distance).
+    // 重用距离按2的幂分桶（单位为缓存行），最后一个桶统计首次访问（距离无穷大）。
+    int64_t reuse[22] = {0};
+};
+
+static void replay(const char *schedule, int64_t l1, int64_t l2, int64_t llc) {
+    CacheLevel levels[3] = {
+        CacheLevel("L1", l1, 8),
+        CacheLevel("L2", l2, 16),
+        CacheLevel("LLC", llc, 16),
+    };
+
+    const std::vector<Access> &stream = recorder.accesses;
+    std::vector<FuncStats> stats(recorder.func_names.size());
+    std::map<int64_t, size_t> last_use;
+    Fenwick live(stream.size());
+
+    for (size_t t = 0; t < stream.size(); t++) {
+        const Access &a = stream[t];
+        FuncStats &s = stats[a.func];
+        s.accesses++;
+
+        // Walk down the hierarchy until some level hits.
+        for (int l = 0; l < 3; l++) {
+            if (levels[l].access(a.line)) break;
+            s.misses[l]++;
+        }
+
+        auto it = last_use.find(a.line);
+        if (it == last_use.end()) {
+            s.reuse[21]++;
+        } else {
+            int64_t distance = live.prefix(t) - live.prefix(it->second);
+            int bucket = 0;
+            while (bucket < 20 && (int64_t(1) << bucket) <= distance) bucket++;
+            s.reuse[bucket]++;
+            live.add(it->second, -1);
+        }
+        live.add(t, 1);
+        last_use[a.line] = t;
+    }
+
+    printf("\n%s: %zu line accesses\n", schedule, stream.size());
+    printf("  %-24s %10s %8s %8s %8s\n", "Func", "accesses", "L1 miss", "L2 miss", "LLC miss");
+    for (size_t f = 0; f < stats.size(); f++) {
+        const FuncStats &s = stats[f];
+        if (s.accesses == 0) continue;
+        printf("  %-24s %10lld %7.2f%% %7.2f%% %7.2f%%\n",
+               recorder.func_names[f].c_str(), (long long)s.accesses,
+               100.0 * s.misses[0] / s.accesses,
+               100.0 * s.misses[1] / s.accesses,
+               100.0 * s.misses[2] / s.accesses);
+    }
+    printf("  Reuse distance (cache lines): <2 / <128 / <32K / >=32K / first touch\n");
+    for (size_t f = 0; f < stats.size(); f++) {
+        const FuncStats &s = stats[f];
+        if (s.accesses == 0) continue;
+        int64_t near = 0, l1ish = 0, l2ish = 0, far = 0;
+        for (int b = 0; b < 21; b++) {
+            if (b <= 1) near += s.reuse[b];
+            else if (b <= 7) l1ish += s.reuse[b];
+            else if (b <= 15) l2ish += s.reuse[b];
+            else far += s.reuse[b];
+        }
+        printf("  %-24s %6.1f%% %6.1f%% %6.1f%% %6.1f%% %6.1f%%\n",
+               recorder.func_names[f].c_str(),
+               100.0 * near / s.accesses, 100.0 * l1ish / s.accesses,
+               100.0 * l2ish / s.accesses, 100.0 * far / s.accesses,
+               100.0 * s.reuse[21] / s.accesses);
+    }
+}
+
+// Realize the consumer with tracing routed into the recorder, then
+// replay the recorded stream.
+// 用自定义的跟踪函数realize消费者，然后回放记录下的访存序列。
+static void simulate(const char *schedule, Func producer, Func consumer, int size,
+                     int64_t l1, int64_t l2, int64_t llc) {
+    producer.trace_loads().trace_stores().trace_realizations();
+    consumer.trace_stores();
+    consumer.set_custom_trace(record_trace);
+
+    recorder.reset();
+    Buffer<float> out(size, size);
+    // The output buffer is allocated by us, not inside the pipeline,
+    // so there is no begin_realization event for it. Register it by
+    // hand.
+    // 输出buffer由我们自己分配，不会产生begin_realization事件，所以手动登记。
+    recorder.allocate(consumer.name(), {0, 0}, {size, size}, sizeof(float));
+    consumer.realize(out);
+
+    replay(schedule, l1, l2, llc);
+}
+
+int main(int argc, char **argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 512;
+    int64_t l1 = (argc > 2 ? atoll(argv[2]) : 32) * 1024;
+    int64_t l2 = (argc > 3 ? atoll(argv[3]) : 1024) * 1024;
+    int64_t llc = (argc > 4 ? atoll(argv[4]) : 32 * 1024) * 1024;
+
+    printf("Simulating %dx%d with L1 = %lldKB, L2 = %lldKB, LLC = %lldKB, %d byte lines\n",
+           size, size, (long long)(l1 / 1024), (long long)(l2 / 1024),
+           (long long)(llc / 1024), kLineBytes);
+
+    Var x("x"), y("y");
+
+    // The schedules from lesson 8, in the same order.
+    // 第八课中的调度，顺序相同
+    {
+        Func producer("producer_root"), consumer("consumer_root");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        producer.compute_root();
+        simulate("producer.compute_root()", producer, consumer, size, l1, l2, llc);
+    }
+
+    {
+        Func producer("producer_y"), consumer("consumer_y");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        producer.compute_at(consumer, y);
+        simulate("producer.compute_at(consumer, y)", producer, consumer, size, l1, l2, llc);
+    }
+
+    {
+        Func producer("producer_root_y"), consumer("consumer_root_y");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        producer.store_root().compute_at(consumer, y);
+        simulate("producer.store_root().compute_at(consumer, y)",
+                 producer, consumer, size, l1, l2, llc);
+    }
+
+    {
+        Func producer("producer_root_x"), consumer("consumer_root_x");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        producer.store_root().compute_at(consumer, x);
+        simulate("producer.store_root().compute_at(consumer, x)",
+                 producer, consumer, size, l1, l2, llc);
+    }
+
+    {
+        Func producer("producer_tile"), consumer("consumer_tile");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        Var x_outer, y_outer, x_inner, y_inner;
+        consumer.tile(x, y, x_outer, y_outer, x_inner, y_inner, 4, 4);
+        producer.compute_at(consumer, x_outer);
+        simulate("tile 4x4, producer.compute_at(consumer, x_outer)",
+                 producer, consumer, size, l1, l2, llc);
+    }
+
+    {
+        // The mixed schedule, without the parallel loop: the model
+        // has a single cache, so interleaving the accesses of several
+        // threads would only add noise.
+        // 混合调度，去掉并行：模型只有一个缓存，多线程交错的访存只会带来噪声。
+        Func producer("producer_mixed"), consumer("consumer_mixed");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        Var yo, yi;
+        consumer.split(y, yo, yi, 16).vectorize(x, 4);
+        producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, 4);
+        simulate("mixed (serial)", producer, consumer, size, l1, l2, llc);
+    }
+
+    // What to look for: with compute_root, the producer's loads have
+    // reuse distances on the order of a scanline or more and, once the
+    // image no longer fits, they start missing in L1 and then L2. With
+    // compute_at(consumer, y) or the tiled schedule, almost all producer
+    // loads hit lines stored a few hundred accesses earlier. That is
+    // what "better locality" means in lesson 8, in numbers.
+    // 观察要点：compute_root时，生产者的load重用距离在一行或更远的量级，当图像放不进缓存时开始在L1
+    // 乃至L2缺失。compute_at(consumer, y)或分块调度时，几乎所有生产者的load都命中不久之前写入的行。
+    // 这就是第八课中"局部性更好"的量化含义。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,415 @@
+// Halide tutorial lesson 14: Reading hardware performance counters around realize()
+// Halide入门教程第十四课：用硬件性能计数器测量realize()
+
+// Wall time tells you which schedule is faster, but not why. In this
+// lesson we wrap realize() for the schedules of lessons 5 and 8 with
+// the Linux perf_event_open counters - cycles, instructions, last
+// level cache misses, branch misses and, on Intel CPUs, retired
+// packed floating point instructions - and report them next to the
+// wall time for each schedule. Together they tell us whether a
+// schedule like gradient_fast is limited by compute or by memory.
+// 计时只能告诉我们哪个调度更快，却不能说明原因。本课用Linux的perf_event_open计数器（时钟周期、指令数、
+// 最后一级缓存缺失、分支预测失败，以及Intel CPU上的向量浮点指令数）包装第五课和第八课中各个调度的
+// realize()，与运行时间一起报告，从而判断gradient_fast这样的调度是受限于计算还是受限于访存。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_14*.cpp -g -std=c++11 -I ../include -L ../bin -lHalide -lpthread -ldl -o lesson_14
+// LD_LIBRARY_PATH=../bin ./lesson_14
+//
+// If every counter reads as "n/a", the kernel isn't letting us count.
+// Counting user-space events of our own process only needs
+// /proc/sys/kernel/perf_event_paranoid to be 2 or less; inside some
+// containers and VMs the counters aren't available at all.
+// 如果所有计数器都显示"n/a"，说明内核不允许计数。只统计本进程的用户态事件需要
+// /proc/sys/kernel/perf_event_paranoid不大于2，某些容器和虚拟机中完全没有计数器。
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace Halide;
+
+// The events we count. Each one is opened separately in every thread
+// that runs Halide code, so a missing event only blanks its own
+// column. That is also why they aren't opened as one group: a group
+// fails as a whole if any member can't be scheduled.
+// 要统计的事件。每个事件在每个运行Halide代码的线程中单独打开，某个事件不可用时只影响它自己那一列。这也是
+// 没有把它们作为一个组打开的原因：只要有一个成员无法调度，整个组都会失败。
+enum Counter {
+    Cycles,
+    Instructions,
+    LLCMisses,
+    BranchMisses,
+    VectorFP,
+    NumCounters
+};
+
+static const char *counter_names[NumCounters] = {
+    "cycles", "instructions", "LLC misses", "branch misses", "vector FP"
+};
+
+static bool is_intel() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.find("vendor_id") == 0) {
+            return line.find("GenuineIntel") != std::string::npos;
+        }
+    }
+    return false;
+}
+
+static int open_counter(Counter c) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // There are more events than hardware counters on many CPUs, and
+    // then the kernel takes turns counting them. Each read also
+    // reports how long the event was enabled and how long it was
+    // actually counting, so we can scale the count up to the whole
+    // interval.
+    // 在很多CPU上事件数多于硬件计数器数，这时内核会轮流统计它们。每次读取时同时报告事件启用的时间和实际
+    // 计数的时间，这样可以把计数按比例放大到整个区间。
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (c) {
+    case Cycles:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case Instructions:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case LLCMisses:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case BranchMisses:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case VectorFP: {
+        // There is no generic event for vector instructions. On Intel
+        // cores since Broadwell, FP_ARITH_INST_RETIRED (event 0xc7)
+        // counts them; umask 0x08, 0x20 and 0x80 select packed single
+        // precision at 128, 256 and 512 bits. That is what the
+        // vectorized producer in lesson 8 runs. Elsewhere we leave the
+        // column blank rather than guess at a raw event number.
+        // 没有通用的向量指令事件。Intel Broadwell之后的核心上，FP_ARITH_INST_RETIRED（事件0xc7）
+        // 可以统计向量浮点指令，umask 0x08、0x20、0x80分别对应128、256、512位的单精度打包指令。
+        // 其他CPU上这一列留空，而不是去猜原始事件编号。
+        static const bool intel = is_intel();
+        if (!intel) return -1;
+        attr.type = PERF_TYPE_RAW;
+        attr.config = ((0x08 | 0x20 | 0x80) << 8) | 0xc7;
+        break;
+    }
+    default:
+        return -1;
+    }
+
+    // pid = 0, cpu = -1: count this thread, on whatever CPU it runs.
+    // pid = 0, cpu = -1：统计当前线程，不论它运行在哪个CPU上。
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Counters have to be opened by the thread they count. Halide's
+// worker threads are created lazily by the runtime, so we can't open
+// counters for them up front. Instead, each thread opens its own the
+// first time it runs a task, and registers them here. Reading a
+// counter that belongs to another thread is fine.
+// 计数器需要由被统计的线程自己打开。Halide的工作线程是运行时按需创建的，我们无法事先为它们打开计数器。
+// 所以每个线程在第一次执行任务时打开自己的计数器并登记到这里。读取其他线程的计数器是允许的。
+struct ThreadCounters {
+    int fd[NumCounters];
+};
+
+static std::mutex registry_lock;
+static std::vector<ThreadCounters> registry;
+static thread_local bool thread_registered = false;
+
+static void register_this_thread() {
+    if (thread_registered) return;
+    thread_registered = true;
+    ThreadCounters t;
+    for (int c = 0; c < NumCounters; c++) {
+        t.fd[c] = open_counter((Counter)c);
+    }
+    std::lock_guard<std::mutex> guard(registry_lock);
+    registry.push_back(t);
+}
+
+// One read of one counter: the raw count, and the nanoseconds it was
+// enabled and actually running.
+// 一个计数器的一次读取：原始计数，以及它启用的时间和实际计数的时间（纳秒）。
+struct Reading {
+    uint64_t value = 0, enabled = 0, running = 0;
+    bool ok = false;
+};
+
+typedef std::vector<std::vector<Reading>> Snapshot;  // [thread][counter]
+
+static Snapshot read_counters() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    Snapshot snapshot(registry.size(), std::vector<Reading>(NumCounters));
+    for (size_t t = 0; t < registry.size(); t++) {
+        for (int c = 0; c < NumCounters; c++) {
+            uint64_t buf[3];
+            Reading &r = snapshot[t][c];
+            if (registry[t].fd[c] >= 0 && read(registry[t].fd[c], buf, sizeof(buf)) == sizeof(buf)) {
+                r.value = buf[0];
+                r.enabled = buf[1];
+                r.running = buf[2];
+                r.ok = true;
+            }
+        }
+    }
+    return snapshot;
+}
+
+// The change in each counter between two snapshots, summed over
+// threads. Each thread's change is scaled by enabled / running over
+// the same interval, so that counters that were only counting part of
+// the time are comparable with each other, and their ratios (IPC,
+// misses per instruction) come out right. Sets 'multiplexed' if any
+// counter was scaled. Returns -1 for counters that no thread could
+// open.
+// 两次快照之间每个计数器的变化量，对所有线程求和。每个线程的变化量按同一区间内enabled / running的比例放大，
+// 这样只统计了部分时间的计数器之间可以互相比较，它们的比值（IPC、每条指令的缺失数）也才是正确的。如果有计数器
+// 被放大过，设置'multiplexed'。任何线程都无法打开的计数器返回-1。
+static void counter_deltas(const Snapshot &before, const Snapshot &after,
+                           double values[NumCounters], bool *multiplexed) {
+    for (int c = 0; c < NumCounters; c++) {
+        values[c] = -1;
+        for (size_t t = 0; t < after.size(); t++) {
+            const Reading &a = after[t][c];
+            if (!a.ok) continue;
+            // A thread that registered in between started from zero.
+            // 在两次快照之间登记的线程从零开始。
+            Reading b = t < before.size() ? before[t][c] : Reading();
+            uint64_t value = a.value - b.value;
+            uint64_t enabled = a.enabled - b.enabled;
+            uint64_t running = a.running - b.running;
+            double scaled = 0;
+            if (running > 0) {
+                scaled = value * ((double)enabled / running);
+            }
+            if (running < enabled) *multiplexed = true;
+            values[c] = (values[c] < 0 ? 0 : values[c]) + scaled;
+        }
+    }
+}
+
+// Halide calls this to run each iteration of a parallel loop. We make
+// sure the calling thread has counters, then run the task the way the
+// default handler does.
+// Halide调用这个函数执行并行循环的每次迭代。我们先确保调用线程已经打开了计数器，然后像默认实现一样执行任务。
+int counting_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
+                     int idx, uint8_t *closure) {
+    register_this_thread();
+    return f(user_context, idx, closure);
+}
+
+// Realize 'f' into 'out' a few times and report the counters per
+// realization.
+// 多次realize，报告每次realize的平均计数。
+template<typename T>
+static void measure(const char *name, Func f, Buffer<T> out) {
+    const int iterations = 10;
+
+    f.set_custom_do_task(counting_do_task);
+    f.compile_jit();
+    // One untimed run, so the thread pool is up and every worker has
+    // registered its counters before we start counting.
+    // 先运行一次不计时，让线程池启动，每个工作线程都登记好计数器。
+    f.realize(out);
+
+    Snapshot before = read_counters();
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        f.realize(out);
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    Snapshot after = read_counters();
+
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count() / iterations;
+    double v[NumCounters];
+    bool multiplexed = false;
+    counter_deltas(before, after, v, &multiplexed);
+    for (int c = 0; c < NumCounters; c++) {
+        if (v[c] >= 0) v[c] /= iterations;
+    }
+
+    printf("%-22s %9.3f", name, ms);
+    for (int c = 0; c < NumCounters; c++) {
+        if (v[c] < 0) printf(" %13s", "n/a");
+        else printf(" %13.0f", v[c]);
+    }
+
+    // A rough classification. A core retiring well under one
+    // instruction per cycle while missing the LLC more than a few
+    // times per thousand instructions is waiting on memory. One that
+    // keeps its IPC high is limited by the work it does.
+    // 粗略的分类：IPC远低于1并且每千条指令LLC缺失超过几次，说明在等待内存；IPC较高则受限于计算量。
+    if (v[Cycles] > 0 && v[Instructions] > 0) {
+        double ipc = v[Instructions] / v[Cycles];
+        printf(" %5.2f", ipc);
+        if (v[LLCMisses] >= 0) {
+            double mpki = 1000 * v[LLCMisses] / v[Instructions];
+            printf(" %7.2f %s", mpki, (ipc < 1.0 && mpki > 5.0) ? "memory-bound" : "compute-bound");
+        }
+    }
+    printf("\n");
+    if (multiplexed) {
+        printf("%-22s (counters were multiplexed; counts are scaled estimates)\n", "");
+    }
+}
+
+static void print_header(const char *title) {
+    printf("\n%s\n", title);
+    printf("%-22s %9s", "schedule", "ms");
+    for (int c = 0; c < NumCounters; c++) {
+        printf(" %13s", counter_names[c]);
+    }
+    printf(" %5s %7s\n", "IPC", "LLC/KI");
+}
+
+int main(int argc, char **argv) {
+    // The main thread runs serial pipelines and the first iteration of
+    // parallel ones itself, so it needs counters too.
+    // 主线程自己执行串行流水线和并行流水线的部分迭代，所以它也需要计数器。
+    register_this_thread();
+
+    Var x("x"), y("y");
+
+    // The schedules from lesson 5, over a 4096x4096 image so the
+    // output doesn't fit in cache.
+    // 第五课中的调度，在4096x4096的图像上运行，使输出无法放进缓存。
+    {
+        print_header("Lesson 5 schedules, 4096x4096");
+        Buffer<int> out(4096, 4096);
+
+        {
+            Func gradient("gradient");
+            gradient(x, y) = x + y;
+            measure("row-major", gradient, out);
+        }
+        {
+            Func gradient("gradient_col_major");
+            gradient(x, y) = x + y;
+            gradient.reorder(y, x);
+            measure("column-major", gradient, out);
+        }
+        {
+            Func gradient("gradient_tiled");
+            gradient(x, y) = x + y;
+            Var x_outer, x_inner, y_outer, y_inner;
+            gradient.tile(x, y, x_outer, y_outer, x_inner, y_inner, 4, 4);
+            measure("tiled 4x4", gradient, out);
+        }
+        {
+            Func gradient("gradient_in_vectors");
+            gradient(x, y) = x + y;
+            gradient.vectorize(x, 4);
+            measure("vectorized", gradient, out);
+        }
+        {
+            Func gradient("gradient_fused_tiles");
+            gradient(x, y) = x + y;
+            Var x_outer, y_outer, x_inner, y_inner, tile_index;
+            gradient
+                .tile(x, y, x_outer, y_outer, x_inner, y_inner, 4, 4)
+                .fuse(x_outer, y_outer, tile_index)
+                .parallel(tile_index);
+            measure("parallel tiles", gradient, out);
+        }
+        {
+            Func gradient_fast("gradient_fast");
+            gradient_fast(x, y) = x + y;
+            Var x_outer, y_outer, x_inner, y_inner, tile_index;
+            gradient_fast
+                .tile(x, y, x_outer, y_outer, x_inner, y_inner, 64, 64)
+                .fuse(x_outer, y_outer, tile_index)
+                .parallel(tile_index);
+            Var x_inner_outer, y_inner_outer, x_vectors, y_pairs;
+            gradient_fast
+                .tile(x_inner, y_inner, x_inner_outer, y_inner_outer, x_vectors, y_pairs, 4, 2)
+                .vectorize(x_vectors)
+                .unroll(y_pairs);
+            measure("gradient_fast", gradient_fast, out);
+        }
+    }
+
+    // The schedules from lesson 8, over a 2048x2048 image.
+    // 第八课中的调度，在2048x2048的图像上运行。
+    {
+        print_header("Lesson 8 schedules, 2048x2048");
+        Buffer<float> out(2048, 2048);
+
+        struct Schedule {
+            const char *name;
+            void (*apply)(Func producer, Func consumer, Var x, Var y);
+        };
+        Schedule schedules[] = {
+            {"inline", [](Func p, Func c, Var x, Var y) {}},
+            {"compute_root", [](Func p, Func c, Var x, Var y) {
+                p.compute_root();
+            }},
+            {"compute_at y", [](Func p, Func c, Var x, Var y) {
+                p.compute_at(c, y);
+            }},
+            {"store_root compute_y", [](Func p, Func c, Var x, Var y) {
+                p.store_root().compute_at(c, y);
+            }},
+            {"store_root compute_x", [](Func p, Func c, Var x, Var y) {
+                p.store_root().compute_at(c, x);
+            }},
+            {"tile 4x4", [](Func p, Func c, Var x, Var y) {
+                Var xo, yo, xi, yi;
+                c.tile(x, y, xo, yo, xi, yi, 4, 4);
+                p.compute_at(c, xo);
+            }},
+            {"mixed", [](Func p, Func c, Var x, Var y) {
+                Var yo, yi;
+                c.split(y, yo, yi, 16).parallel(yo).vectorize(x, 4);
+                p.store_at(c, yo).compute_at(c, yi).vectorize(x, 4);
+            }},
+        };
+
+        for (const Schedule &s : schedules) {
+            Func producer("producer"), consumer("consumer");
+            producer(x, y) = sin(x * y);
+            consumer(x, y) = (producer(x, y) +
+                              producer(x, y+1) +
+                              producer(x+1, y) +
+                              producer(x+1, y+1))/4;
+            s.apply(producer, consumer, x, y);
+            measure(s.name, consumer, out);
+        }
+    }
+
+    // What to expect: the gradient is one add per 4-byte store, so
+    // every gradient schedule that vectorizes or parallelizes ends up
+    // waiting on memory, and gradient_fast shows a low IPC and a high
+    // LLC miss rate. The column-major schedule is memory-bound for a
+    // different reason - it touches a new cache line on every store.
+    // The lesson 8 producer calls sin, so those schedules are
+    // compute-bound, and the ones that call sin the fewest times win.
+    // 预期结果：gradient每4字节的存储只有一次加法，所以任何向量化或并行化的gradient调度都会等待内存，
+    // gradient_fast的IPC较低而LLC缺失率较高。列优先的调度也受限于访存，原因是每次存储都访问一个新的缓存行。
+    // 第八课的生产者调用sin，所以这些调度受限于计算，调用sin次数最少的调度最快。
+
+    printf("Success!\n");
+    return 0;
+}
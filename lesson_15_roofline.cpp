@@ -0,0 +1,264 @@
+// Halide tutorial lesson 15: How far from peak? Placing the lesson pipelines on a roofline
+// Halide入门教程第十五课：离峰值还有多远？用Roofline模型评估各课的流水线
+
+// A schedule can be faster than another one and still be nowhere near
+// what the machine can do. This lesson first measures what the
+// machine can do - sustainable memory bandwidth, using the four STREAM
+// kernels written as Halide Funcs, and peak vector arithmetic
+// throughput - and then places each pipeline from the earlier lessons
+// on the resulting roofline. For every pipeline it prints the fraction
+// of the attainable performance that the schedule actually reaches.
+// 一个调度比另一个快，并不代表它接近机器的能力上限。本课先测量机器的能力：用Halide实现STREAM的四个
+// 内核测量可持续内存带宽，再测量向量运算的峰值吞吐。然后把前面几课的流水线放到roofline上，
+// 报告每个流水线达到了可达性能的百分之多少。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_15*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_15
+// LD_LIBRARY_PATH=../bin ./lesson_15
+
+#include "Halide.h"
+#include <stdio.h>
+#include <algorithm>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// The roofline: a kernel that does 'ops' operations while moving
+// 'bytes' bytes can't go faster than the peak arithmetic rate, nor
+// faster than the memory system can deliver its bytes.
+// Roofline模型：一个执行ops次运算、搬运bytes字节的内核，既不能超过峰值运算速度，也不能超过内存系统
+// 提供数据的速度。
+struct Roofline {
+    double peak_gops;  // operations per second / 1e9
+    double peak_gbps;  // bytes per second / 1e9
+
+    double attainable_gops(double intensity) const {
+        return std::min(peak_gops, intensity * peak_gbps);
+    }
+};
+
+static void report(const Roofline &roof, const char *name,
+                   double seconds, double ops, double bytes) {
+    double intensity = ops / bytes;
+    double achieved = ops / seconds / 1e9;
+    double attainable = roof.attainable_gops(intensity);
+    printf("%-20s %9.3f %9.3f %10.3f %10.2f %10.2f %7.1f%% %s\n",
+           name, seconds * 1e3, intensity, bytes / seconds / 1e9,
+           achieved, attainable, 100.0 * achieved / attainable,
+           intensity * roof.peak_gbps < roof.peak_gops ? "memory" : "compute");
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y"), c("c");
+    Var xo("xo"), xi("xi"), yo("yo"), yi("yi");
+
+    const int vec = get_host_target().natural_vector_size<float>();
+
+    // Part 1: memory bandwidth.
+    // 第一部分：内存带宽
+    //
+    // The four STREAM kernels over arrays of 32M floats each, 128MB
+    // per array, far bigger than any cache. Each is split into chunks
+    // of 64K elements that run in parallel, and vectorized. Bytes are
+    // counted the STREAM way: each element read or written once, with
+    // no allowance for the write-allocate traffic of the stores.
+    // STREAM的四个内核，每个数组3200万个float（128MB），远大于任何缓存。按64K个元素分块并行，
+    // 并进行向量化。字节数按STREAM的方式统计：每个元素读或写一次，不计写分配带来的额外流量。
+    double best_gbps = 0;
+    {
+        const int n = 32 * 1024 * 1024;
+        const float scalar = 3.0f;
+        Buffer<float> a(n), b(n), cc(n);
+        a.fill(1.0f);
+        b.fill(2.0f);
+        cc.fill(0.0f);
+
+        Func copy("copy"), scale("scale"), add("add"), triad("triad");
+        copy(x) = a(x);
+        scale(x) = scalar * cc(x);
+        add(x) = a(x) + b(x);
+        triad(x) = b(x) + scalar * cc(x);
+
+        struct Kernel {
+            const char *name;
+            Func f;
+            Buffer<float> out;
+            int arrays;
+        };
+        Kernel kernels[] = {
+            {"copy", copy, cc, 2},
+            {"scale", scale, b, 2},
+            {"add", add, cc, 3},
+            {"triad", triad, a, 3},
+        };
+
+        printf("%-8s %10s %10s\n", "kernel", "ms", "GB/s");
+        for (Kernel &k : kernels) {
+            k.f.split(x, xo, xi, 64 * 1024).parallel(xo).vectorize(xi, vec);
+            k.f.compile_jit();
+            double t = benchmark(5, 3, [&]() { k.f.realize(k.out); });
+            double gbps = (double)k.arrays * n * sizeof(float) / t / 1e9;
+            best_gbps = std::max(best_gbps, gbps);
+            printf("%-8s %10.3f %10.2f\n", k.name, t * 1e3, gbps);
+        }
+    }
+
+    // Part 2: peak arithmetic throughput.
+    // 第二部分：峰值运算吞吐
+    //
+    // Each output element runs 8 independent chains of 64
+    // multiply-adds. The chains are independent so the core can keep
+    // several in flight at once, and they depend on x so nothing can
+    // be folded away at compile time. The output is small and stays in
+    // cache, so memory doesn't get a say.
+    // 每个输出元素运行8条相互独立的链，每条链64次乘加。链之间相互独立，使处理器可以同时执行多条；
+    // 它们依赖于x，所以不会在编译期被化简。输出很小并且留在缓存中，不受内存影响。
+    double peak_gops = 0;
+    {
+        const int chains = 8, depth = 64;
+        const int n = 1024 * 1024;
+        std::vector<Expr> acc;
+        for (int k = 0; k < chains; k++) {
+            acc.push_back(cast<float>(x + k));
+        }
+        for (int d = 0; d < depth; d++) {
+            for (int k = 0; k < chains; k++) {
+                acc[k] = acc[k] * 0.999f + 0.001f;
+            }
+        }
+        Expr sum = acc[0];
+        for (int k = 1; k < chains; k++) {
+            sum += acc[k];
+        }
+        Func peak("peak");
+        peak(x) = sum;
+        peak.split(x, xo, xi, 4096).parallel(xo).vectorize(xi, vec);
+
+        Buffer<float> out(n);
+        peak.compile_jit();
+        double t = benchmark(5, 3, [&]() { peak.realize(out); });
+        // Two operations per multiply-add, plus the final sum.
+        // 每次乘加算两次运算，再加上最后的求和。
+        double ops = (double)n * (chains * depth * 2 + chains - 1);
+        peak_gops = ops / t / 1e9;
+        printf("%-8s %10.3f %10.2f GOP/s\n", "peak", t * 1e3, peak_gops);
+    }
+
+    Roofline roof = {peak_gops, best_gbps};
+    printf("\nRoofline: %.2f GOP/s peak, %.2f GB/s, ridge point at %.2f ops/byte\n\n",
+           roof.peak_gops, roof.peak_gbps, roof.peak_gops / roof.peak_gbps);
+
+    // Part 3: the lesson pipelines.
+    // 第三部分：各课的流水线
+    //
+    // We count bytes as the minimum traffic to main memory - each input
+    // read once, each output written once - so intermediates that a
+    // schedule keeps in cache cost nothing. Operations are counted from
+    // the algorithm, one per arithmetic operation in the Expr; casts and
+    // clamps on addresses don't count. sin() is counted as 20, roughly
+    // the size of the polynomial Halide evaluates for it. A different
+    // convention moves the points, but the same convention for every
+    // pipeline keeps them comparable.
+    // 字节数按最小的主存流量统计：每个输入读一次，每个输出写一次，调度留在缓存中的中间结果不计。
+    // 运算次数按算法统计，表达式中的每个算术运算算一次，类型转换和地址的clamp不计。sin()按20次计算，
+    // 大致是Halide计算sin时多项式的规模。采用不同的统计方式会移动这些点，但对所有流水线使用同样的方式
+    // 就可以相互比较。
+    printf("%-20s %9s %9s %10s %10s %10s %8s %s\n",
+           "pipeline", "ms", "ops/byte", "GB/s", "GOP/s", "roof GOP/s", "of roof", "bound");
+
+    const int width = 3840, height = 2160;
+    Buffer<uint8_t> image(width, height, 3);
+    fill_synthetic(image);
+    const double pixels = (double)width * height;
+
+    // Brighten, from lesson 2: a multiply and a min per value.
+    // 第二课的提亮：每个值一次乘法和一次min
+    {
+        Func brighter("brighter");
+        brighter(x, y, c) = cast<uint8_t>(min(image(x, y, c) * 1.5f, 255.0f));
+        brighter.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, vec * 2);
+
+        Buffer<uint8_t> out(width, height, 3);
+        brighter.compile_jit();
+        double t = benchmark(5, 5, [&]() { brighter.realize(out); });
+        report(roof, "brighter", t, pixels * 3 * 2, pixels * 3 * 2);
+    }
+
+    // The clamped blur, from lesson 7: three adds and a shift in each
+    // direction, four ops per pass per value.
+    // 第七课中带边界条件的模糊：每个方向三次加法和一次移位，每个值每遍4次运算。
+    {
+        Func clamped = BoundaryConditions::repeat_edge(image);
+        Func input_16("input_16"), blur_x("blur_x"), blur_y("blur_y"), output("output");
+        input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+        blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+        blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+        output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+
+        output.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, vec * 2);
+        blur_x.store_at(output, yo).compute_at(output, yi).vectorize(x, vec * 2);
+
+        Buffer<uint8_t> out(width, height, 3);
+        output.compile_jit();
+        double t = benchmark(5, 5, [&]() { output.realize(out); });
+        report(roof, "blur", t, pixels * 3 * 8, pixels * 3 * 2);
+    }
+
+    // The producer/consumer with the mixed schedule, from lesson 8:
+    // a multiply and a sin in the producer, three adds and a divide in
+    // the consumer. The mixed schedule computes each producer value
+    // about once.
+    // 第八课中采用混合调度的生产者-消费者：生产者一次乘法和一次sin，消费者三次加法和一次除法。
+    // 混合调度下每个生产者的值大约只计算一次。
+    {
+        Func producer("producer"), consumer("consumer");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                          producer(x+1, y) + producer(x+1, y+1))/4;
+        consumer.split(y, yo, yi, 16).parallel(yo).vectorize(x, vec);
+        producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, vec);
+
+        Buffer<float> out(width, height);
+        consumer.compile_jit();
+        double t = benchmark(5, 5, [&]() { consumer.realize(out); });
+        report(roof, "producer/consumer", t, pixels * (1 + 20 + 4), pixels * 4);
+    }
+
+    // gradient_fast, from lesson 5: one add per 32-bit store.
+    // 第五课中的gradient_fast：每次32位存储一次加法
+    {
+        Func gradient_fast("gradient_fast");
+        gradient_fast(x, y) = x + y;
+        Var x_outer, y_outer, x_inner, y_inner, tile_index;
+        gradient_fast
+            .tile(x, y, x_outer, y_outer, x_inner, y_inner, 64, 64)
+            .fuse(x_outer, y_outer, tile_index)
+            .parallel(tile_index);
+        Var x_inner_outer, y_inner_outer, x_vectors, y_pairs;
+        gradient_fast
+            .tile(x_inner, y_inner, x_inner_outer, y_inner_outer, x_vectors, y_pairs, 4, 2)
+            .vectorize(x_vectors)
+            .unroll(y_pairs);
+
+        Buffer<int> out(width, height);
+        gradient_fast.compile_jit();
+        double t = benchmark(5, 5, [&]() { gradient_fast.realize(out); });
+        report(roof, "gradient_fast", t, pixels, pixels * 4);
+    }
+
+    // Reading the table: 'bound' says which roof a kernel sits under.
+    // For the memory-bound ones the last percentage is the fraction of
+    // the measured STREAM bandwidth they reach, and the way to go
+    // faster is to move fewer bytes. For the compute-bound ones it is
+    // the fraction of peak arithmetic, and the way to go faster is to
+    // vectorize better or do less work.
+    // 表格解读：'bound'说明内核处在哪一条屋顶线下。受限于访存的内核，百分比是达到的STREAM带宽比例，
+    // 提速的办法是减少搬运的字节数；受限于计算的内核，百分比是达到的峰值运算比例，
+    // 提速的办法是更好地向量化或减少计算量。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,473 @@
+// Halide tutorial lesson 16: Huge pages, thread pinning and NUMA-local first touch
+// Halide入门教程第十六课：大页内存、线程绑核与NUMA本地首次访问
+
+// A compute_root intermediate at production size is big: the lesson 8
+// producer at 8192x8192 is 256MB of floats, and blur_x over an 8K RGB
+// frame is about 200MB of uint16. Halide allocates these with malloc,
+// and the pages land on whichever NUMA node the thread that first
+// writes them runs on. On a dual-socket server that is often the
+// wrong one, and with 4KB pages the TLB can't cover the buffer either.
+// 生产尺寸下compute_root的中间结果很大：第八课的生产者在8192x8192时是256MB的float，8K RGB图像的
+// blur_x大约是200MB的uint16。Halide用malloc分配这些内存，物理页落在第一次写它的线程所在的NUMA节点上。
+// 在双路服务器上这常常是错误的节点，而且4KB的页面使TLB无法覆盖整个buffer。
+//
+// This lesson plugs three configurable pieces into the JIT runtime:
+// 1) An allocator that backs large allocations with transparent huge
+//    pages (madvise) or explicit huge pages (MAP_HUGETLB).
+// 2) Thread pinning: every worker thread is bound to one core.
+// 3) A static parallel-for, so strip i of the producer and strip i of
+//    the consumer always run on the same pinned core. The producer's
+//    pages are then first touched, and later read, by the same core,
+//    which keeps them on the local NUMA node.
+// 本课向JIT运行时注入三个可配置的部分：
+// 1) 内存分配器：大块内存使用透明大页(madvise)或显式大页(MAP_HUGETLB)
+// 2) 线程绑核：每个工作线程绑定到一个核上
+// 3) 静态划分的并行循环：生产者的第i个条带和消费者的第i个条带总是在同一个核上运行，
+//    这样生产者的页面由同一个核首次写入并随后读取，从而留在本地NUMA节点上。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_16*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_16
+// LD_LIBRARY_PATH=../bin ./lesson_16
+//
+// Explicit huge pages must be reserved first, e.g.
+// echo 1024 | sudo tee /sys/kernel/mm/hugepages/hugepages-2048kB/nr_hugepages
+// Without them the 'hugetlb' allocator falls back to transparent huge
+// pages, and its rows are labelled 'hugetlb (fell back to thp)'.
+// 使用显式大页前需要先预留。没有预留时'hugetlb'分配器退化为透明大页，对应的行标记为'hugetlb (fell back to thp)'。
+//
+// The numbers only get interesting on a multi-socket machine. On a
+// single socket the pinning and first-touch rows should be roughly
+// equal to the default ones; only the huge page rows change.
+// 只有在多路服务器上结果才有意义。单路机器上绑核和首次访问的结果应与默认情况相近，只有大页会带来变化。
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// ---------------------------------------------------------------------
+// 1) Allocation
+// 1) 内存分配
+// ---------------------------------------------------------------------
+
+enum AllocMode { AllocMalloc, AllocTHP, AllocHugeTLB };
+static const char *alloc_names[] = {"malloc", "thp", "hugetlb"};
+static AllocMode alloc_mode = AllocMalloc;
+
+// Set when a MAP_HUGETLB mapping fails and the allocator falls back to
+// transparent huge pages, so that the results aren't labelled hugetlb
+// when they are really a second thp run.
+// 当MAP_HUGETLB映射失败、分配器退化为透明大页时设置，以免把实际上是又一次透明大页的结果标记为hugetlb。
+static std::atomic<bool> hugetlb_fell_back(false);
+
+static const char *alloc_label(AllocMode mode) {
+    if (mode == AllocHugeTLB && hugetlb_fell_back) return "hugetlb (fell back to thp)";
+    return alloc_names[mode];
+}
+
+// Only big buffers are worth a huge page. The small per-scanline and
+// per-tile allocations of the other schedules keep using malloc.
+// 只有大块内存才值得使用大页，其他调度中每行、每块的小分配仍然使用malloc。
+static const size_t kHugePage = 2 * 1024 * 1024;
+static const size_t kHugeThreshold = 4 * kHugePage;
+
+static std::mutex mapped_lock;
+static std::map<void *, size_t> mapped;
+
+void *numa_malloc(void *user_context, size_t size) {
+    if (alloc_mode == AllocMalloc || size < kHugeThreshold) {
+        // Halide needs memory aligned to at least 32 bytes from its
+        // allocator. We align to 64, a whole cache line.
+        // Halide要求分配器返回至少32字节对齐的内存，这里按64字节（一整条缓存行）对齐。
+        void *p = nullptr;
+        return posix_memalign(&p, 64, size) == 0 ? p : nullptr;
+    }
+
+    size_t len = (size + kHugePage - 1) / kHugePage * kHugePage;
+    void *p = MAP_FAILED;
+    if (alloc_mode == AllocHugeTLB) {
+        p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) hugetlb_fell_back = true;
+    }
+    if (p == MAP_FAILED) {
+        // Transparent huge pages need a 2MB-aligned range. Over-map by
+        // one huge page and trim the ends.
+        // 透明大页需要2MB对齐的地址范围。多映射一个大页，然后裁掉两端。
+        char *raw = (char *)mmap(nullptr, len + kHugePage, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return nullptr;
+        char *aligned = (char *)(((uintptr_t)raw + kHugePage - 1) & ~(uintptr_t)(kHugePage - 1));
+        if (aligned > raw) munmap(raw, aligned - raw);
+        munmap(aligned + len, raw + kHugePage - aligned);
+        madvise(aligned, len, MADV_HUGEPAGE);
+        p = aligned;
+    }
+
+    // The pages are not touched here. Whichever core writes each page
+    // first decides which NUMA node it lives on.
+    // 这里不访问页面，由第一个写入每个页面的核决定它所在的NUMA节点。
+    std::lock_guard<std::mutex> guard(mapped_lock);
+    mapped[p] = len;
+    return p;
+}
+
+void numa_free(void *user_context, void *ptr) {
+    {
+        std::lock_guard<std::mutex> guard(mapped_lock);
+        auto it = mapped.find(ptr);
+        if (it != mapped.end()) {
+            munmap(ptr, it->second);
+            mapped.erase(it);
+            return;
+        }
+    }
+    free(ptr);
+}
+
+// ---------------------------------------------------------------------
+// 2) and 3) Threads
+// 2)和3) 线程
+// ---------------------------------------------------------------------
+
+enum ThreadMode { ThreadsDefault, ThreadsPinned, ThreadsStatic };
+static const char *thread_names[] = {"default", "pinned", "static+pinned"};
+
+// The CPUs we may run on, in the order we hand them out. Ordering by
+// NUMA node means a contiguous block of strips maps to one socket.
+// 我们可以使用的CPU，按NUMA节点排序，使连续的条带落在同一路CPU上。
+static std::vector<int> cpu_order;
+static int numa_nodes = 0;
+// The affinity we started with, to go back to after pinning.
+// 启动时的亲和性，绑核之后用它来恢复。
+static cpu_set_t default_affinity;
+
+static void discover_cpus() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    default_affinity = allowed;
+
+    std::vector<bool> placed(CPU_SETSIZE, false);
+    for (int node = 0;; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+        DIR *dir = opendir(path);
+        if (!dir) break;
+        numa_nodes++;
+        struct dirent *entry;
+        std::vector<int> cpus;
+        while ((entry = readdir(dir)) != nullptr) {
+            int cpu;
+            if (sscanf(entry->d_name, "cpu%d", &cpu) == 1 && cpu < CPU_SETSIZE &&
+                CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        closedir(dir);
+        std::sort(cpus.begin(), cpus.end());
+        for (int cpu : cpus) {
+            cpu_order.push_back(cpu);
+            placed[cpu] = true;
+        }
+    }
+    // No NUMA information (or CPUs it didn't list): take them in order.
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && !placed[cpu]) cpu_order.push_back(cpu);
+    }
+    if (numa_nodes == 0) numa_nodes = 1;
+}
+
+static void pin_to(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void unpin() {
+    pthread_setaffinity_np(pthread_self(), sizeof(default_affinity), &default_affinity);
+}
+
+// Pinned mode: Halide's own thread pool, with each thread bound to
+// the next CPU the first time it runs a task. Tasks are still handed
+// out dynamically, so strip i of two different loops may run on
+// different cores.
+//
+// The default mode goes through the same handler, which puts a thread
+// that an earlier pinned configuration left bound back on all the
+// CPUs before it runs anything, the main thread included. Each
+// configuration starts a new generation, and a thread settles its
+// affinity once per generation.
+// 绑核模式：使用Halide自己的线程池，每个线程第一次执行任务时绑定到下一个CPU。
+// 任务仍然是动态分配的，所以两个循环的第i个条带可能在不同的核上运行。
+//
+// 默认模式也经过同一个处理函数：之前的绑核配置留下的被绑定的线程（包括主线程），在执行任何任务之前都会
+// 恢复到所有CPU上。每种配置开始一个新的代，每个线程在每一代中只设置一次亲和性。
+static std::atomic<int> next_cpu(0);
+static std::atomic<bool> pin_threads(false);
+static std::atomic<int> pin_generation(0);
+static thread_local int thread_generation = -1;
+static thread_local bool thread_pinned = false;
+
+static void start_generation(bool pin) {
+    pin_threads = pin;
+    next_cpu = 0;
+    pin_generation++;
+}
+
+int affinity_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
+                     int idx, uint8_t *closure) {
+    if (thread_generation != pin_generation) {
+        thread_generation = pin_generation;
+        if (pin_threads) {
+            pin_to(cpu_order[next_cpu++ % cpu_order.size()]);
+            thread_pinned = true;
+        } else if (thread_pinned) {
+            unpin();
+            thread_pinned = false;
+        }
+    }
+    return f(user_context, idx, closure);
+}
+
+// Static mode: our own pool of pinned threads. Every parallel loop is
+// cut into one contiguous block of iterations per thread, so thread t
+// always gets the same strips of every loop with the same extent.
+// 静态模式：我们自己的绑核线程池。每个并行循环被切成每线程一段连续的迭代，
+// 所以对于范围相同的循环，线程t总是得到同样的条带。
+class StaticPool {
+public:
+    explicit StaticPool(const std::vector<int> &cpus) {
+        for (size_t t = 0; t < cpus.size(); t++) {
+            int cpu = cpus[t];
+            workers.emplace_back([this, t, cpu]() { worker((int)t, cpu); });
+        }
+        // Wait until every worker has pinned itself.
+        std::unique_lock<std::mutex> lock(m);
+        done_cv.wait(lock, [&]() { return ready == (int)workers.size(); });
+    }
+
+    ~StaticPool() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            shutdown = true;
+            generation++;
+        }
+        work_cv.notify_all();
+        for (std::thread &t : workers) t.join();
+    }
+
+    int par_for(void *ctx, int (*f)(void *, int, uint8_t *), int min, int extent, uint8_t *closure) {
+        std::unique_lock<std::mutex> lock(m);
+        job = {ctx, f, min, extent, closure};
+        result = 0;
+        remaining = (int)workers.size();
+        generation++;
+        work_cv.notify_all();
+        done_cv.wait(lock, [&]() { return remaining == 0; });
+        return result;
+    }
+
+    static thread_local bool in_pool;
+
+private:
+    struct Job {
+        void *ctx;
+        int (*f)(void *, int, uint8_t *);
+        int min, extent;
+        uint8_t *closure;
+    };
+
+    void worker(int t, int cpu) {
+        pin_to(cpu);
+        in_pool = true;
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m);
+        ready++;
+        done_cv.notify_all();
+        while (true) {
+            work_cv.wait(lock, [&]() { return generation != seen; });
+            seen = generation;
+            if (shutdown) return;
+            Job j = job;
+            lock.unlock();
+
+            int n = (int)workers.size();
+            int lo = j.min + (int)((int64_t)j.extent * t / n);
+            int hi = j.min + (int)((int64_t)j.extent * (t + 1) / n);
+            int err = 0;
+            for (int i = lo; i < hi && err == 0; i++) {
+                err = j.f(j.ctx, i, j.closure);
+            }
+
+            lock.lock();
+            if (err) result = err;
+            if (--remaining == 0) done_cv.notify_all();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable work_cv, done_cv;
+    Job job;
+    int result = 0, remaining = 0, ready = 0;
+    uint64_t generation = 0;
+    bool shutdown = false;
+};
+
+thread_local bool StaticPool::in_pool = false;
+static StaticPool *static_pool = nullptr;
+
+int static_do_par_for(void *user_context, int (*f)(void *, int, uint8_t *),
+                      int min, int extent, uint8_t *closure) {
+    // A parallel loop inside a parallel loop just runs serially on the
+    // thread that reached it.
+    // 并行循环内部的并行循环直接在当前线程上串行执行。
+    if (StaticPool::in_pool) {
+        for (int i = min; i < min + extent; i++) {
+            int err = f(user_context, i, closure);
+            if (err) return err;
+        }
+        return 0;
+    }
+    return static_pool->par_for(user_context, f, min, extent, closure);
+}
+
+// Install the handlers for one configuration.
+// 为一种配置安装各个处理函数。
+static void configure(Func f, ThreadMode threads) {
+    f.set_custom_allocator(numa_malloc, numa_free);
+    if (threads == ThreadsStatic) {
+        f.set_custom_do_par_for(static_do_par_for);
+    } else {
+        start_generation(threads == ThreadsPinned);
+        f.set_custom_do_task(affinity_do_task);
+    }
+}
+
+int main(int argc, char **argv) {
+    discover_cpus();
+    printf("%d NUMA node(s), %d CPUs\n", numa_nodes, (int)cpu_order.size());
+    if (numa_nodes == 1) {
+        printf("Single NUMA node: expect only the huge page rows to differ.\n");
+    }
+
+    StaticPool pool(cpu_order);
+    static_pool = &pool;
+
+    Var x("x"), y("y"), c("c"), yo("yo"), yi("yi");
+    const int strip = 64;
+
+    // Both pipelines parallelize the producer over strips of scanlines
+    // with the same strip height as the consumer. That is what lets the
+    // static pool give each core the same strip of both: the
+    // producer's pages are first touched by the core that will read
+    // them.
+    // 两个流水线都让生产者按与消费者相同高度的条带并行，这样静态线程池就能把两者的同一条带交给同一个核：
+    // 生产者的页面由将要读取它们的核首次写入。
+
+    // The lesson 8 producer, compute_root, at 8192x8192.
+    // 第八课的生产者，compute_root，8192x8192
+    const int pc_size = 8192;
+    Buffer<float> pc_reference;
+
+    // The clamped blur from lesson 7 with blur_x computed at root,
+    // over an 8K frame.
+    // 第七课中带边界条件的模糊，blur_x采用compute_root，8K图像
+    const int blur_w = 7680, blur_h = 4320;
+    Buffer<uint8_t> image(blur_w, blur_h, 3);
+    fill_synthetic(image);
+    Buffer<uint8_t> blur_reference;
+
+    printf("\n%-18s %-26s %-14s %10s\n", "pipeline", "alloc", "threads", "ms");
+    for (int a = 0; a < 3; a++) {
+        for (int t = 0; t < 3; t++) {
+            alloc_mode = (AllocMode)a;
+            ThreadMode threads = (ThreadMode)t;
+            hugetlb_fell_back = false;
+
+            {
+                Func producer("producer"), consumer("consumer");
+                producer(x, y) = sin(x * y);
+                consumer(x, y) = (producer(x, y) + producer(x, y+1) +
+                                  producer(x+1, y) + producer(x+1, y+1))/4;
+                consumer.split(y, yo, yi, strip).parallel(yo).vectorize(x, 8);
+                producer.compute_root().split(y, yo, yi, strip).parallel(yo).vectorize(x, 8);
+                configure(consumer, threads);
+
+                Buffer<float> out(pc_size, pc_size);
+                consumer.compile_jit();
+                double ms = benchmark(3, 3, [&]() { consumer.realize(out); }) * 1e3;
+                printf("%-18s %-26s %-14s %10.2f\n", "producer_root", alloc_label(alloc_mode), thread_names[t], ms);
+
+                // Every configuration runs the same code, so the
+                // results must be identical.
+                // 所有配置运行的是同样的代码，所以结果必须完全相同。
+                if (!pc_reference.defined()) {
+                    pc_reference = out;
+                } else if (memcmp(out.data(), pc_reference.data(), out.size_in_bytes()) != 0) {
+                    printf("producer_root output differs with %s/%s\n", alloc_names[a], thread_names[t]);
+                    return -1;
+                }
+            }
+
+            {
+                Func clamped = BoundaryConditions::repeat_edge(image);
+                Func input_16("input_16"), blur_x("blur_x"), blur_y("blur_y"), output("output");
+                input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+                blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+                blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+                output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+
+                output.reorder(x, y, c).split(y, yo, yi, strip).parallel(yo).vectorize(x, 16);
+                blur_x.compute_root().reorder(x, y, c).split(y, yo, yi, strip).parallel(yo).vectorize(x, 16);
+                configure(output, threads);
+
+                Buffer<uint8_t> out(blur_w, blur_h, 3);
+                output.compile_jit();
+                hugetlb_fell_back = false;
+                double ms = benchmark(3, 3, [&]() { output.realize(out); }) * 1e3;
+                printf("%-18s %-26s %-14s %10.2f\n", "blur_x root (8K)", alloc_label(alloc_mode), thread_names[t], ms);
+
+                if (!blur_reference.defined()) {
+                    blur_reference = out;
+                } else if (memcmp(out.data(), blur_reference.data(), out.size_in_bytes()) != 0) {
+                    printf("blur output differs with %s/%s\n", alloc_names[a], thread_names[t]);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // On a dual-socket server, the 'static+pinned' rows should show the
+    // biggest gain: each socket reads only its own half of the
+    // intermediate. 'pinned' alone helps less, because Halide's
+    // dynamic task queue still hands strips of the consumer to
+    // whichever core is free. Huge pages help everywhere, by cutting
+    // the number of TLB misses when streaming through a few hundred MB.
+    // 在双路服务器上，'static+pinned'的提升应该最大：每路CPU只读取属于自己的那一半中间结果。
+    // 单独绑核的帮助较小，因为Halide的动态任务队列仍然会把消费者的条带交给任意空闲的核。
+    // 大页在任何机器上都有帮助，它减少了遍历几百MB内存时的TLB缺失。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,258 @@
+// Halide tutorial lesson 17: Processing a batch of images in one realization
+// Halide入门教程第十七课：一次realize处理一批图像
+
+// The brighten pipeline from lesson 2 and the blur from lesson 7 each
+// process one (x, y, c) image per call to realize(). For a large frame
+// that's fine, but for a batch of small thumbnails the fixed cost of
+// each call - checking the buffers, waking up the thread pool, and
+// waiting for the slowest thread at the end - is paid again for every
+// image. This lesson adds a fourth dimension, n, for the image within
+// the batch, so one realize() covers the whole batch. Then the
+// schedule can choose to parallelize over images or over tiles of
+// each image.
+// 第二课的提亮和第七课的模糊每次realize()只处理一张(x, y, c)图像。对于大图这没有问题，但对于一批
+// 小的缩略图，每次调用的固定开销（检查buffer、唤醒线程池、等待最慢的线程）每张图都要付一次。
+// 本课增加第四个维度n表示图像在批次中的序号，一次realize()处理整批图像，调度可以选择在图像之间
+// 并行，或者在每张图像的分块之间并行。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_17*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_17
+// LD_LIBRARY_PATH=../bin ./lesson_17
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// How a batched pipeline is parallelized.
+// 批处理流水线的并行方式
+enum BatchSchedule {
+    // One task per image. Each image is processed start to finish by
+    // one thread, which is ideal when there are many more images than
+    // threads.
+    // 每张图像一个任务，一个线程从头到尾处理一张图像。图像数远多于线程数时最理想。
+    OverImages,
+    // One task per strip of scanlines of each image, all images'
+    // strips in one parallel loop. This keeps every thread busy when
+    // there are only a few large images.
+    // 每张图像的每个行条带一个任务，所有图像的条带放在一个并行循环中。只有少量大图时能让每个线程都忙起来。
+    OverTiles
+};
+
+static const int kStrip = 32;
+
+// Pick a schedule from the shape of the batch. Parallelizing over
+// images has no overhead from strip boundaries (the blur recomputes
+// the rows above and below each strip), but it only balances well
+// when every thread gets several images.
+// 根据批次的形状选择调度。在图像之间并行没有条带边界的开销（模糊在每个条带的上下边界会重复计算），
+// 但只有当每个线程能分到多张图像时负载才均衡。
+//
+// What matters is how many threads Halide's pool will use, not how
+// many cores there are. The pool takes that from HL_NUM_THREADS when
+// it is set, and uses one thread per core otherwise.
+// 重要的是Halide线程池会使用多少个线程，而不是机器有多少个核。线程池在设置了HL_NUM_THREADS时使用它的值，
+// 否则每个核一个线程。
+static int halide_thread_count() {
+    const char *env = getenv("HL_NUM_THREADS");
+    int threads = env ? atoi(env) : 0;
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+static BatchSchedule choose_schedule(int batch, int height) {
+    int threads = halide_thread_count();
+    int strips = (height + kStrip - 1) / kStrip;
+    if (batch >= 4 * threads) return OverImages;
+    if (batch * strips < 4 * threads) return OverImages;
+    return OverTiles;
+}
+
+// The two pipelines over a 4-D input. Most of this is lessons 2 and
+// 7 with an extra 'n' on every Func.
+// 四维输入上的两个流水线，基本上就是第二课和第七课，每个Func多了一个'n'。
+struct Pipelines {
+    ImageParam input;
+    Func brighter, clamped, input_16, blur_x, blur_y, blurred;
+    Var x, y, c, n;
+
+    explicit Pipelines(int dims)
+        : input(UInt(8), dims, "input"),
+          brighter("brighter"), clamped("clamped"), input_16("input_16"),
+          blur_x("blur_x"), blur_y("blur_y"), blurred("blurred"),
+          x("x"), y("y"), c("c"), n("n") {
+        std::vector<Var> args = {x, y, c};
+        if (dims == 4) args.push_back(n);
+        std::vector<Expr> at = {x, y, c};
+        if (dims == 4) at.push_back(n);
+
+        brighter(args) = cast<uint8_t>(min(input(at) * 1.5f, 255.0f));
+
+        // Clamp only x and y: there is no 'edge' in c or n to repeat.
+        // 只对x和y做边界处理，c和n方向没有边界。
+        clamped = BoundaryConditions::repeat_edge(input,
+                                                  {{input.dim(0).min(), input.dim(0).extent()},
+                                                   {input.dim(1).min(), input.dim(1).extent()}});
+
+        auto shifted = [&](Expr dx, Expr dy) {
+            std::vector<Expr> a = {x + dx, y + dy, c};
+            if (dims == 4) a.push_back(n);
+            return a;
+        };
+        input_16(args) = cast<uint16_t>(clamped(at));
+        blur_x(args) = (input_16(shifted(-1, 0)) + 2 * input_16(at) + input_16(shifted(1, 0))) / 4;
+        blur_y(args) = (blur_x(shifted(0, -1)) + 2 * blur_x(at) + blur_x(shifted(0, 1))) / 4;
+        blurred(args) = cast<uint8_t>(blur_y(at));
+    }
+
+    // The single-image schedule, for the baseline: parallel strips of
+    // each image, as in the earlier lessons.
+    // 单张图像的调度作为基准：与前几课一样，每张图像按条带并行。
+    void schedule_single() {
+        Var yo("yo"), yi("yi");
+        brighter.reorder(x, y, c).split(y, yo, yi, kStrip).parallel(yo).vectorize(x, 16);
+        blurred.reorder(x, y, c).split(y, yo, yi, kStrip).parallel(yo).vectorize(x, 16);
+        blur_x.store_at(blurred, yo).compute_at(blurred, yi).vectorize(x, 16);
+    }
+
+    void schedule_batched(BatchSchedule s) {
+        Var yo("yo"), yi("yi"), task("task");
+        if (s == OverImages) {
+            // Everything for one image happens inside one iteration of
+            // the parallel loop over n. blur_x is stored per image and
+            // computed per scanline, sliding down the image.
+            // 一张图像的所有计算都在n的并行循环的一次迭代中完成。blur_x按图像存储，按行计算，沿图像向下滑动。
+            brighter.reorder(x, y, c, n).parallel(n).vectorize(x, 16);
+            blurred.reorder(x, y, c, n).parallel(n).vectorize(x, 16);
+            blur_x.store_at(blurred, n).compute_at(blurred, y).vectorize(x, 16);
+        } else {
+            // Split y into strips and fuse the strip index with n, so
+            // one parallel loop covers every strip of every image.
+            // 把y拆分成条带，将条带序号与n融合，一个并行循环覆盖所有图像的所有条带。
+            brighter.reorder(x, y, c, n).split(y, yo, yi, kStrip)
+                .reorder(x, yi, c, yo, n).fuse(yo, n, task).parallel(task).vectorize(x, 16);
+            blurred.reorder(x, y, c, n).split(y, yo, yi, kStrip)
+                .reorder(x, yi, c, yo, n).fuse(yo, n, task).parallel(task).vectorize(x, 16);
+            blur_x.store_at(blurred, task).compute_at(blurred, yi).vectorize(x, 16);
+        }
+    }
+};
+
+template<typename F>
+static double time_it(F f) {
+    return benchmark(5, 3, f);
+}
+
+int main(int argc, char **argv) {
+    struct Case {
+        const char *name;
+        int width, height, batch;
+    };
+    Case cases[] = {
+        {"thumbnails 128x128", 128, 128, 256},
+        {"thumbnails 256x256", 256, 256, 64},
+        {"frames 1920x1080", 1920, 1080, 4},
+    };
+
+    // Compile everything once, outside of the timing loops.
+    // 所有流水线只编译一次，不计入计时。
+    Pipelines single(3);
+    single.schedule_single();
+    single.brighter.compile_jit();
+    single.blurred.compile_jit();
+
+    Pipelines over_images(4), over_tiles(4);
+    over_images.schedule_batched(OverImages);
+    over_tiles.schedule_batched(OverTiles);
+    over_images.brighter.compile_jit();
+    over_images.blurred.compile_jit();
+    over_tiles.brighter.compile_jit();
+    over_tiles.blurred.compile_jit();
+
+    printf("Halide threads: %d\n", halide_thread_count());
+    printf("%-20s %-9s %12s %12s %12s  %s\n",
+           "batch", "pipeline", "per-image", "over n", "over tiles", "chosen");
+
+    for (const Case &k : cases) {
+        // The whole batch lives in one 4-D buffer; each image is a
+        // slice of it.
+        // 整个批次存放在一个四维buffer中，每张图像是它的一个切片。
+        Buffer<uint8_t> batch(k.width, k.height, 3, k.batch);
+        fill_synthetic(batch);
+        Buffer<uint8_t> out_single(k.width, k.height, 3, k.batch);
+        Buffer<uint8_t> out_images(k.width, k.height, 3, k.batch);
+        Buffer<uint8_t> out_tiles(k.width, k.height, 3, k.batch);
+        Buffer<uint8_t> output(k.width, k.height, 3, k.batch);
+
+        // This is what a production caller does: ask the chooser, and
+        // run only that schedule. Everything else below is there to
+        // show how its choice compares.
+        // 这就是实际使用时的做法：询问选择函数，只运行它选中的调度。下面其他的内容都是为了展示这个选择与其他
+        // 方式相比如何。
+        BatchSchedule chosen = choose_schedule(k.batch, k.height);
+        Pipelines &production = chosen == OverImages ? over_images : over_tiles;
+
+        for (int p = 0; p < 2; p++) {
+            const char *pipeline = p == 0 ? "brighter" : "blur";
+            Func Pipelines::*which = p == 0 ? &Pipelines::brighter : &Pipelines::blurred;
+
+            // The baseline: one realize() per image, through 3-D views
+            // of the batch.
+            // 基准：每张图像调用一次realize()，使用批次buffer的三维视图。
+            double t_single = time_it([&]() {
+                for (int i = 0; i < k.batch; i++) {
+                    Buffer<uint8_t> in_slice = batch.sliced(3, i);
+                    Buffer<uint8_t> out_slice = out_single.sliced(3, i);
+                    single.input.set(in_slice);
+                    (single.*which).realize(out_slice);
+                }
+            });
+
+            over_images.input.set(batch);
+            double t_images = time_it([&]() { (over_images.*which).realize(out_images); });
+
+            over_tiles.input.set(batch);
+            double t_tiles = time_it([&]() { (over_tiles.*which).realize(out_tiles); });
+
+            production.input.set(batch);
+            (production.*which).realize(output);
+
+            // All of them must agree exactly.
+            // 所有方式的结果必须完全一致。
+            if (memcmp(out_single.data(), out_images.data(), out_single.size_in_bytes()) != 0 ||
+                memcmp(out_single.data(), out_tiles.data(), out_single.size_in_bytes()) != 0 ||
+                memcmp(out_single.data(), output.data(), out_single.size_in_bytes()) != 0) {
+                printf("%s %s: batched output differs from per-image output\n", k.name, pipeline);
+                return -1;
+            }
+
+            double t_chosen = chosen == OverImages ? t_images : t_tiles;
+            double t_other = chosen == OverImages ? t_tiles : t_images;
+            printf("%-20s %-9s %9.3f ms %9.3f ms %9.3f ms  %s%s\n",
+                   k.name, pipeline, t_single * 1e3, t_images * 1e3, t_tiles * 1e3,
+                   chosen == OverImages ? "over n" : "over tiles",
+                   t_chosen <= t_other ? "" : " (the other was faster)");
+        }
+    }
+
+    // For the thumbnails, the per-image loop is dominated by per-call
+    // overhead and by threads idling at the end of every tiny image,
+    // and parallelizing over n wins by a wide margin. For a handful of
+    // full HD frames there aren't enough images to go around, and the
+    // fused strip loop keeps every core busy. choose_schedule() encodes
+    // that crossover; check its pick against the two columns on your
+    // machine and adjust the thresholds if needed.
+    // 对于缩略图，逐张处理的开销主要来自每次调用的固定开销以及每张小图结束时线程的空闲，在n上并行明显更快。
+    // 对于少量全高清图像，图像数量不够分配给所有线程，融合后的条带循环能让每个核都忙起来。
+    // choose_schedule()描述了这个分界点，可以在自己的机器上对照两列结果调整阈值。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+// Halide tutorial lesson 18: Recomputing only what an edit changed
+// Halide入门教程第十八课：只重新计算被编辑影响的区域
+
+// In an interactive editor, each brush stroke changes a small
+// rectangle of the input, but the lesson 7 blur would rerun over the
+// whole frame to show the result. This lesson works out which part of
+// the output a dirty input rectangle can affect, and realizes the blur
+// over just that part, writing straight into the existing output
+// image. We use two things from earlier lessons: Halide's bounds
+// inference, to find how far the blur reaches, and realizing over a
+// shifted domain (lesson 6), to fill in a sub-rectangle of the output.
+// 在交互式编辑器中，每一笔只改变输入的一个小矩形，但第七课的模糊会在整幅图像上重新计算。本课计算出
+// 脏矩形可能影响的输出区域，只在这部分区域上realize模糊，直接写入已有的输出图像。这里用到了前面课程
+// 中的两个内容：用Halide的边界推断得到模糊的作用范围，以及在平移的区域上realize（第六课）来填充输出的
+// 一个子矩形。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_18*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_18
+// LD_LIBRARY_PATH=../bin ./lesson_18
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// The blur from lesson 7 over an ImageParam, optionally with the
+// boundary condition.
+// 第七课的模糊，输入为ImageParam，可选是否带边界条件。
+static Func make_blur(ImageParam input, bool clamp_input, const std::string &name) {
+    Var x("x"), y("y"), c("c");
+    Func source;
+    if (clamp_input) {
+        source = BoundaryConditions::repeat_edge(input);
+    } else {
+        source(x, y, c) = input(x, y, c);
+    }
+
+    Func input_16(name + "_input_16"), blur_x(name + "_blur_x"), blur_y(name + "_blur_y");
+    Func output(name);
+    input_16(x, y, c) = cast<uint16_t>(source(x, y, c));
+    blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+    blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+    output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+    return output;
+}
+
+// The footprint of one output pixel: the input pixel (0, 0) is read
+// by outputs whose x lies in [-max_x, -min_x], and likewise for y.
+// 单个输出像素的作用范围。
+struct Footprint {
+    int min_x, max_x, min_y, max_y;
+};
+
+// Ask Halide how much input one output pixel at (0, 0) reads. We use
+// the unclamped pipeline: with the boundary condition in place Halide
+// would (rightly) report that it reads the whole input, since the
+// clamp can pull any coordinate in. The clamp only changes what
+// happens at the edges, so the unclamped footprint is the one that
+// matters for an edit in the interior, and clipping to the image
+// takes care of the edges.
+// 询问Halide计算(0, 0)处的一个输出像素需要读取多少输入。这里使用不带边界条件的流水线：有边界条件时，
+// Halide会（正确地）报告需要读取整个输入，因为clamp可以把任何坐标拉进来。clamp只改变边缘处的行为，
+// 所以内部编辑只需要不带边界条件的作用范围，边缘由裁剪到图像范围来处理。
+static Footprint infer_footprint() {
+    ImageParam probe(UInt(8), 3, "probe");
+    Func unclamped = make_blur(probe, false, "unclamped");
+
+    // With no buffer bound to 'probe', infer_input_bounds allocates
+    // one of exactly the size needed to compute a 1x1x1 output.
+    // 'probe'没有绑定buffer时，infer_input_bounds会分配一个刚好足够计算1x1x1输出的buffer。
+    unclamped.infer_input_bounds(1, 1, 1);
+    Buffer<uint8_t> needed = probe.get();
+
+    Footprint f;
+    f.min_x = needed.dim(0).min();
+    f.max_x = needed.dim(0).max();
+    f.min_y = needed.dim(1).min();
+    f.max_y = needed.dim(1).max();
+    return f;
+}
+
+// An axis-aligned rectangle, inclusive of both ends.
+struct Rect {
+    int x0, y0, x1, y1;
+};
+
+// The output pixels a change to the input inside 'dirty' can affect:
+// output x reads input [x + min_x, x + max_x], so it sees input p if
+// x lies in [p - max_x, p - min_x]. Clip to the image.
+// 输入中'dirty'区域的变化可能影响的输出像素：输出x读取输入[x + min_x, x + max_x]，所以当x位于
+// [p - max_x, p - min_x]时会读到输入p。最后裁剪到图像范围。
+static Rect affected_region(const Rect &dirty, const Footprint &f, int width, int height) {
+    Rect r;
+    r.x0 = std::max(dirty.x0 - f.max_x, 0);
+    r.x1 = std::min(dirty.x1 - f.min_x, width - 1);
+    r.y0 = std::max(dirty.y0 - f.max_y, 0);
+    r.y1 = std::min(dirty.y1 - f.min_y, height - 1);
+    return r;
+}
+
+// The schedule below vectorizes x by 16 and splits y by 32, and
+// Halide handles the last vector and strip by shifting them inwards
+// (see lesson 5). That needs the realized region to be at least one
+// vector wide and one strip tall, so a tiny region at the edge of the
+// image is grown to that size. Computing a few extra output pixels is
+// harmless: they get the same values they already had.
+// 下面的调度在x方向以16向量化，在y方向以32拆分，Halide通过向内平移处理最后一个向量和条带（见第五课）。
+// 这要求realize的区域至少有一个向量宽、一个条带高，所以图像边缘的小区域要扩大到这个尺寸。多计算几个输出
+// 像素是无害的，它们得到的值与原来相同。
+static void grow_to(int &lo, int &hi, int min_size, int limit) {
+    if (hi - lo + 1 >= min_size) return;
+    hi = std::min(lo + min_size - 1, limit - 1);
+    lo = std::max(hi - min_size + 1, 0);
+}
+
+int main(int argc, char **argv) {
+    Footprint footprint = infer_footprint();
+    printf("One output pixel reads input x in [%d, %d], y in [%d, %d]\n",
+           footprint.min_x, footprint.max_x, footprint.min_y, footprint.max_y);
+
+    // The pipeline we actually run: the clamped blur, scheduled for
+    // big frames. Because it is compiled over an ImageParam, the same
+    // code handles the full frame and any sub-rectangle.
+    // 实际运行的流水线：带边界条件的模糊，按大图调度。因为输入是ImageParam，同一份代码既可以处理整幅图像，
+    // 也可以处理任意子矩形。
+    ImageParam input(UInt(8), 3, "input");
+    Func blur = make_blur(input, true, "blur");
+    Var x = blur.args()[0], y = blur.args()[1], c = blur.args()[2];
+    Var yo("yo"), yi("yi");
+    blur.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, 16);
+    blur.compile_jit();
+
+    const int width = 3840, height = 2160;
+    Buffer<uint8_t> image(width, height, 3);
+    fill_synthetic(image);
+    input.set(image);
+
+    // Compute the whole frame once, as lesson 7 does.
+    Buffer<uint8_t> output(width, height, 3);
+    blur.realize(output);
+
+    // Now a series of small edits. Each paints a 24x24 square of the
+    // input, then brings the output up to date.
+    // 接下来进行一系列小的编辑，每次修改输入中一个24x24的方块，然后更新输出。
+    srand(0);
+    Buffer<uint8_t> reference(width, height, 3);
+    double incremental_total = 0, full_total = 0;
+    const int edits = 20;
+    for (int e = 0; e < edits; e++) {
+        Rect dirty;
+        dirty.x0 = rand() % width;
+        dirty.y0 = rand() % height;
+        dirty.x1 = std::min(dirty.x0 + 23, width - 1);
+        dirty.y1 = std::min(dirty.y0 + 23, height - 1);
+        uint8_t paint = (uint8_t)(rand() & 255);
+        for (int ch = 0; ch < 3; ch++) {
+            for (int py = dirty.y0; py <= dirty.y1; py++) {
+                for (int px = dirty.x0; px <= dirty.x1; px++) {
+                    image(px, py, ch) = paint;
+                }
+            }
+        }
+
+        Rect r = affected_region(dirty, footprint, width, height);
+        grow_to(r.x0, r.x1, 16, width);
+        grow_to(r.y0, r.y1, 32, height);
+
+        // A crop of the output is a buffer whose min is the top-left
+        // corner of the region and which shares storage with the full
+        // output. It's the same trick as set_min in lesson 6, except
+        // that the pixels land directly in the existing image.
+        // 输出的一个裁剪视图，它的min是区域的左上角，并与完整的输出共享存储。这与第六课中的set_min相同，
+        // 只是像素直接写入已有的图像。
+        Buffer<uint8_t> window = output
+            .cropped(0, r.x0, r.x1 - r.x0 + 1)
+            .cropped(1, r.y0, r.y1 - r.y0 + 1);
+
+        incremental_total += benchmark(1, 1, [&]() { blur.realize(window); });
+
+        // The full recompute, for correctness and for comparison.
+        // 完整的重新计算，用于检查正确性和比较性能。
+        full_total += benchmark(1, 1, [&]() { blur.realize(reference); });
+
+        for (int ch = 0; ch < 3; ch++) {
+            for (int py = 0; py < height; py++) {
+                for (int px = 0; px < width; px++) {
+                    if (output(px, py, ch) != reference(px, py, ch)) {
+                        printf("After edit %d, output(%d, %d, %d) = %d instead of %d\n",
+                               e, px, py, ch, output(px, py, ch), reference(px, py, ch));
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Average per edit: incremental %.3f ms, full frame %.3f ms (%.0fx)\n",
+           incremental_total / edits * 1e3, full_total / edits * 1e3,
+           full_total / incremental_total);
+
+    // The region we recompute is the dirty rectangle grown by the
+    // blur's reach, one pixel on each side here. If the pipeline
+    // changes - a wider kernel, another stage - infer_footprint() picks
+    // that up without any changes to the update logic.
+    // 重新计算的区域是脏矩形按模糊的作用范围向外扩展，这里是每边一个像素。如果流水线改变了（更宽的卷积核、
+    // 更多的阶段），infer_footprint()会自动得到新的范围，更新逻辑不需要任何改动。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Halide tutorial lesson 19: Reusing producer results across realizations with memoize()
+// Halide入门教程第十九课：用memoize()在多次realize之间重用生产者的结果
+
+// The lesson 8 producer, sin(x * y), depends only on the coordinates.
+// If we realize the consumer over a window, then over a window that
+// overlaps it, the producer values in the overlap come out the same
+// both times, yet every realize() computes them again. Func::memoize()
+// tells Halide to keep the results of a Func in a cache shared by all
+// realizations, keyed by the region computed and any parameters the
+// Func uses, and to skip the computation when the key is already
+// there.
+// 第八课的生产者sin(x * y)只依赖于坐标。如果在一个窗口上realize消费者，然后在与它重叠的另一个窗口上
+// realize，重叠部分的生产者值两次完全相同，但每次realize()都会重新计算。Func::memoize()告诉Halide
+// 把这个Func的结果保存在所有realize共享的缓存中，以计算的区域和Func用到的参数作为键，键已经存在时
+// 跳过计算。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_19*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_19
+// LD_LIBRARY_PATH=../bin ./lesson_19
+
+#include "Halide.h"
+#include <stdio.h>
+#include <atomic>
+#include <string>
+
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// Cache statistics. Halide doesn't report hits and misses directly,
+// but we can count them with a trace handler: a memoized Func still
+// begins a realization each time it is needed, but it only 'produces'
+// when the lookup misses.
+// 缓存统计。Halide不直接报告命中和缺失次数，但可以用跟踪函数统计：被memoize的Func每次被需要时
+// 仍然会开始一次realization，但只有在缓存缺失时才会'produce'。
+static std::atomic<int> lookups(0), misses(0), next_id(1);
+
+int count_cache_events(void *user_context, const halide_trace_event_t *e) {
+    if (e->event == halide_trace_begin_realization) {
+        lookups++;
+    } else if (e->event == halide_trace_produce) {
+        misses++;
+    }
+    return next_id++;
+}
+
+static const int kTile = 64;
+
+// The lesson 8 pipeline with a producer expensive enough to be worth
+// caching. The consumer is tiled, and the producer is computed per
+// tile, so each cache entry is one tile's worth of producer.
+// 第八课的流水线，生产者的计算量足够大，值得缓存。消费者分块计算，生产者按块计算，
+// 所以每个缓存项是一个块所需的生产者数据。
+struct Pipeline8 {
+    Func producer, consumer;
+    Var x, y, xo, yo, xi, yi;
+
+    Pipeline8(const std::string &name, bool memoized)
+        : producer("producer_" + name), consumer("consumer_" + name),
+          x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi") {
+        Expr value = sin(x * y);
+        for (int i = 1; i <= 6; i++) {
+            value += sin(value * i + x) * cos(value - i * y);
+        }
+        producer(x, y) = value;
+        consumer(x, y) = (producer(x, y) +
+                          producer(x, y+1) +
+                          producer(x+1, y) +
+                          producer(x+1, y+1))/4;
+
+        consumer.tile(x, y, xo, yo, xi, yi, kTile, kTile).vectorize(xi, 8).parallel(yo);
+        producer.compute_at(consumer, xo).vectorize(x, 8);
+        if (memoized) {
+            // The key is the region of the producer computed for the
+            // tile: 65x65 starting at the tile's top-left corner. Two
+            // windows share an entry only where their tile grids line
+            // up, which is why the windows below move in steps of one
+            // tile.
+            // 键是为这个块计算的生产者区域：从块左上角开始的65x65。两个窗口只有在块网格对齐的地方才共享
+            // 缓存项，所以下面的窗口每次移动一个块的距离。
+            producer.memoize();
+            producer.trace_realizations();
+            consumer.set_custom_trace(count_cache_events);
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    // The workload: a 512x512 viewport panning right across a wide
+    // canvas in steps of one tile, then panning back. Consecutive
+    // windows overlap by 7/8, and the way back revisits every window.
+    // 负载：一个512x512的视口在宽画布上以一个块的步长向右平移，然后再平移回来。相邻窗口有7/8重叠，
+    // 返回的路上会重新访问每个窗口。
+    const int window = 512, steps = 32;
+    std::vector<std::pair<int, int>> origins;
+    for (int i = 0; i <= steps; i++) origins.push_back({i * kTile, 0});
+    for (int i = steps; i >= 0; i--) origins.push_back({i * kTile, 0});
+
+    auto pan = [&](Pipeline8 &p, Buffer<float> &out) {
+        for (auto o : origins) {
+            out.set_min(o.first, o.second);
+            p.consumer.realize(out);
+        }
+    };
+
+    Pipeline8 plain("plain", false);
+    plain.consumer.compile_jit();
+    Buffer<float> plain_out(window, window);
+    double plain_time = benchmark(3, 1, [&]() { pan(plain, plain_out); });
+    printf("%-26s %10.2f ms\n", "no memoization", plain_time * 1e3);
+
+    // Each cache entry is 65 * 65 floats, about 17KB, and one full
+    // sweep touches 8 * 40 = 320 distinct tiles, about 5.4MB. Sweep the
+    // cache size from too small for one window to big enough for the
+    // whole pan.
+    // 每个缓存项是65*65个float，约17KB，一次完整的平移访问8 * 40 = 320个不同的块，约5.4MB。
+    // 缓存大小从放不下一个窗口一直扫描到足够容纳整个平移过程。
+    const int64_t sizes_mb[] = {1, 4, 16, 64};
+    for (int64_t mb : sizes_mb) {
+        // The cache is shared by every memoized Func in the process and
+        // evicts the least recently used entries once it is over this
+        // size.
+        // 缓存由进程中所有被memoize的Func共享，超过这个大小时淘汰最近最少使用的项。
+        Internal::JITSharedRuntime::memoization_cache_set_size(mb * 1024 * 1024);
+
+        // The Func's name is part of every cache key, so a fresh name
+        // per size means this run can't hit entries left over from the
+        // previous one.
+        // Func的名字是缓存键的一部分，每个缓存大小使用新的名字，保证不会命中上一次运行留下的缓存项。
+        Pipeline8 memo("memo_" + std::to_string(mb) + "mb", true);
+        memo.consumer.compile_jit();
+        Buffer<float> memo_out(window, window);
+
+        // One sweep, starting from an empty cache, is what we time and
+        // count: a repeated sweep would be all hits and tell us little.
+        // 只对从空缓存开始的一次平移计时和统计：重复的平移会全部命中，没有参考价值。
+        lookups = 0;
+        misses = 0;
+        double memo_time = benchmark(1, 1, [&]() { pan(memo, memo_out); });
+        int l = lookups, m = misses;
+
+        char label[64];
+        snprintf(label, sizeof(label), "memoize, %lld MB cache", (long long)mb);
+        printf("%-26s %10.2f ms   lookups %7d  hits %7d  misses %7d  hit rate %5.1f%%\n",
+               label, memo_time * 1e3, l, l - m, m, l ? 100.0 * (l - m) / l : 0.0);
+
+        // A cache hit must give the same answer as recomputing. The
+        // last window of the pan is the first one again, so check it.
+        // 命中缓存的结果必须与重新计算相同。平移的最后一个窗口就是第一个窗口，检查它。
+        plain_out.set_min(0, 0);
+        plain.consumer.realize(plain_out);
+        memo_out.set_min(0, 0);
+        memo.consumer.realize(memo_out);
+        for (int y = 0; y < window; y++) {
+            for (int x = 0; x < window; x++) {
+                if (memo_out(x, y) != plain_out(x, y)) {
+                    printf("memo_out(%d, %d) = %f instead of %f\n",
+                           x, y, memo_out(x, y), plain_out(x, y));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // With a cache too small to hold one window's tiles (about 1.1MB
+    // for 64 tiles), LRU eviction throws every tile out before the
+    // viewport comes back to it, and memoization only adds the cost of
+    // the lookups. Once the cache holds a window, each step only
+    // computes the new column of tiles, and the way back is nearly all
+    // hits. Memoize a stage when it is expensive, its inputs repeat,
+    // and a realistic working set of its results fits in the budget.
+    // 缓存小到放不下一个窗口的所有块（64个块约1.1MB）时，LRU淘汰会在视口回来之前把每个块都清除掉，
+    // memoize只增加了查找的开销。缓存能容纳一个窗口后，每一步只需要计算新出现的一列块，返回的路上
+    // 几乎全部命中。当一个阶段计算代价高、输入会重复出现、并且结果的工作集能放进缓存预算时，就值得memoize。
+
+    printf("Success!\n");
+    return 0;
+}
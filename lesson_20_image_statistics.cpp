@@ -0,0 +1,262 @@
+// Halide tutorial lesson 20: Parallel image statistics with RDom and rfactor
+// Halide入门教程第二十课：用RDom和rfactor并行计算图像统计量
+
+// After brightening (lesson 2) or blurring (lesson 7) an image we
+// often want to know something about the result: its histogram, its
+// mean and variance, its darkest and brightest values. Written the
+// obvious way, with an RDom over the whole image, each of these is a
+// serial loop over every pixel, run as a second pass after the image
+// is done. This lesson does better in three steps:
+// 1) A single histogram is enough. The outputs are 8-bit, so min,
+//    max, mean and variance can all be read off the 256 bins.
+// 2) rfactor splits the histogram into one partial histogram per strip
+//    of scanlines, computed in parallel, and then sums the partials.
+// 3) The histogram goes in the same Pipeline as the image, reading the
+//    producing stage directly rather than being a separate realize().
+// 提亮（第二课）或模糊（第七课）之后，我们经常需要了解结果的统计信息：直方图、均值和方差、最暗和最亮的值。
+// 直接用覆盖整幅图像的RDom来写，每个统计量都是一个遍历所有像素的串行循环，并且要在图像计算完之后作为
+// 第二遍单独执行。本课分三步改进：
+// 1) 只需要一个直方图：输出是8位的，最小值、最大值、均值和方差都可以从256个桶中得到。
+// 2) rfactor把直方图拆成每个行条带一个局部直方图，并行计算，然后把局部直方图相加。
+// 3) 直方图与图像放在同一个Pipeline中，直接读取产生图像的阶段，而不是单独调用一次realize()。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_20*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_20
+// LD_LIBRARY_PATH=../bin ./lesson_20
+
+#include "Halide.h"
+#include <stdio.h>
+#include <math.h>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// Per-channel statistics, as computed on the C++ side from the
+// reduction outputs.
+// 每个通道的统计量
+struct ChannelStats {
+    int min, max;
+    double mean, variance;
+};
+
+// The serial version: an ImageParam holding a finished image, one
+// RDom over all of it, and a loop that visits one pixel at a time.
+// 串行版本：ImageParam中是已经算好的图像，一个覆盖整幅图像的RDom，每次访问一个像素。
+struct SerialStats {
+    ImageParam image;
+    Func hist, stats;
+    Var i, c;
+
+    SerialStats() : image(UInt(8), 3, "image"), hist("hist_serial"), stats("stats_serial"),
+                    i("i"), c("c") {
+        RDom r(0, image.width(), 0, image.height());
+        Expr v = image(r.x, r.y, c);
+
+        hist(i, c) = cast<uint32_t>(0);
+        hist(cast<int>(v), c) += cast<uint32_t>(1);
+
+        // min, max, sum and sum of squares in one Tuple, so at least
+        // they share a single pass.
+        // 最小值、最大值、和、平方和放在一个Tuple中，至少可以共享同一遍遍历。
+        stats(c) = Tuple(cast<uint8_t>(255), cast<uint8_t>(0),
+                         cast<uint64_t>(0), cast<uint64_t>(0));
+        stats(c) = Tuple(min(stats(c)[0], v), max(stats(c)[1], v),
+                         stats(c)[2] + cast<uint64_t>(v),
+                         stats(c)[3] + cast<uint64_t>(v) * cast<uint64_t>(v));
+    }
+};
+
+// The parallel, single-pass version, attached to a producing stage.
+// 并行、单遍的版本，直接连接到产生图像的阶段。
+struct FusedStats {
+    Func hist, stats;
+    Var i, c, u;
+
+    FusedStats(Func stage, Expr width, Expr height, const std::string &name)
+        : hist("hist_" + name), stats("stats_" + name), i("i"), c("c"), u("u") {
+        RDom r(0, width, 0, height);
+
+        hist(i, c) = cast<uint32_t>(0);
+        hist(cast<int>(stage(r.x, r.y, c)), c) += cast<uint32_t>(1);
+
+        // Split the rows of the reduction domain into strips of 32, and
+        // ask rfactor for an intermediate with one partial histogram
+        // per strip, indexed by the new pure Var u. Addition is
+        // associative and commutative, which is what lets rfactor
+        // reorder the sum; Halide proves that for us.
+        // 把归约域的行拆成32行的条带，让rfactor生成一个中间函数，每个条带一个局部直方图，用新的纯变量u
+        // 索引。加法满足结合律和交换律，rfactor正是依靠这一点重排求和，Halide会自动证明这一点。
+        RVar ryo("ryo"), ryi("ryi");
+        hist.update().split(r.y, ryo, ryi, 32);
+        Func partial = hist.update().rfactor(ryo, u);
+
+        // The partial histograms have no dependence on each other, so
+        // the loop over u can be parallel. Clearing the bins and
+        // summing the partials are pure per-bin loops, so they
+        // vectorize.
+        // 各个局部直方图互不依赖，所以u上的循环可以并行。清零和求和都是逐桶的纯循环，可以向量化。
+        partial.compute_root().vectorize(i, 8);
+        partial.update().parallel(u);
+        hist.compute_root().vectorize(i, 8);
+        hist.update().vectorize(i, 8);
+
+        // Everything else comes from the 256 bins.
+        // 其他统计量都从256个桶中得到。
+        RDom b(0, 256);
+        Expr count = cast<uint64_t>(hist(b, c));
+        Expr bin = cast<uint64_t>(b);
+        stats(c) = Tuple(cast<uint8_t>(255), cast<uint8_t>(0),
+                         cast<uint64_t>(0), cast<uint64_t>(0));
+        stats(c) = Tuple(select(count > 0, min(stats(c)[0], cast<uint8_t>(b)), stats(c)[0]),
+                         select(count > 0, max(stats(c)[1], cast<uint8_t>(b)), stats(c)[1]),
+                         stats(c)[2] + count * bin,
+                         stats(c)[3] + count * bin * bin);
+    }
+};
+
+static void summarize(Buffer<uint8_t> mins, Buffer<uint8_t> maxs,
+                      Buffer<uint64_t> sums, Buffer<uint64_t> sumsqs,
+                      double pixels, ChannelStats out[3]) {
+    for (int ch = 0; ch < 3; ch++) {
+        out[ch].min = mins(ch);
+        out[ch].max = maxs(ch);
+        out[ch].mean = sums(ch) / pixels;
+        out[ch].variance = sumsqs(ch) / pixels - out[ch].mean * out[ch].mean;
+    }
+}
+
+static bool same(const ChannelStats a[3], const ChannelStats b[3]) {
+    for (int ch = 0; ch < 3; ch++) {
+        if (a[ch].min != b[ch].min || a[ch].max != b[ch].max ||
+            fabs(a[ch].mean - b[ch].mean) > 1e-9 ||
+            fabs(a[ch].variance - b[ch].variance) > 1e-6) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int width = 3840, height = 2160;
+    const double pixels = (double)width * height;
+
+    Buffer<uint8_t> input(width, height, 3);
+    fill_synthetic(input);
+
+    Var x("x"), y("y"), c("c"), yo("yo"), yi("yi");
+
+    // The two stages whose output we summarize.
+    // 需要统计输出的两个阶段
+    Func brighter("brighter");
+    brighter(x, y, c) = cast<uint8_t>(min(input(x, y, c) * 1.5f, 255.0f));
+
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func input_16("input_16"), blur_x("blur_x"), blur_y("blur_y"), blurred("blurred");
+    input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+    blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+    blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+    blurred(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+
+    // A pipeline output is always computed into its buffer, so for the
+    // histogram to see brightened pixels in registers it needs its own
+    // copy of the definition, left inlined.
+    // 流水线的输出总是会被计算到它的buffer中，所以为了让直方图直接在寄存器中拿到提亮后的像素，
+    // 需要一份相同定义、保持内联的Func。
+    Func brighten_inline("brighten_inline");
+    brighten_inline(x, y, c) = cast<uint8_t>(min(input(x, y, c) * 1.5f, 255.0f));
+
+    brighter.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, 16);
+    blurred.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, 16);
+    blur_x.store_at(blurred, yo).compute_at(blurred, yi).vectorize(x, 16);
+
+    SerialStats serial;
+    serial.hist.compile_jit();
+    serial.stats.compile_jit();
+
+    // Each stage, and the Func its histogram reads.
+    // 每个阶段，以及它的直方图读取的Func。
+    struct Stage {
+        const char *name;
+        Func f, source;
+    };
+    Stage stages[] = {{"brighter", brighter, brighten_inline}, {"blur", blurred, blurred}};
+
+    for (Stage &s : stages) {
+        Buffer<uint8_t> image(width, height, 3);
+        Buffer<uint32_t> hist(256, 3);
+        Buffer<uint8_t> mins(3), maxs(3);
+        Buffer<uint64_t> sums(3), sumsqs(3);
+
+        // Today's approach: realize the image, then run the statistics
+        // over the finished image as a second, serial pass.
+        // 现有的做法：先realize图像，然后在完成的图像上串行地计算统计量。
+        s.f.compile_jit();
+        ChannelStats serial_stats[3];
+        double t_two_pass = benchmark(3, 1, [&]() {
+            s.f.realize(image);
+            serial.image.set(image);
+            serial.hist.realize(hist);
+            serial.stats.realize({mins, maxs, sums, sumsqs});
+        });
+        summarize(mins, maxs, sums, sumsqs, pixels, serial_stats);
+        Buffer<uint32_t> serial_hist = hist.copy();
+
+        // The fused version: one Pipeline with three outputs. For the
+        // brighten, the histogram recomputes the cheap per-pixel
+        // expression inline, so a brightened pixel goes straight from
+        // registers into the histogram. The blur is a stencil and too
+        // costly to compute twice, so it is computed once into the
+        // output image and the histogram reads it back within the same
+        // realization.
+        // 融合的版本：一个有三个输出的Pipeline。对于提亮，直方图内联地重新计算这个廉价的逐像素表达式，
+        // 提亮后的像素直接从寄存器进入直方图。模糊是模板运算，计算两次代价太高，所以只计算一次写入输出图像，
+        // 直方图在同一次realize中读回。
+        FusedStats fused(s.source, width, height, s.name);
+        Pipeline p({s.f, fused.hist, fused.stats});
+        p.compile_jit();
+        ChannelStats fused_stats[3];
+        double t_fused = benchmark(3, 1, [&]() {
+            p.realize({image, hist, mins, maxs, sums, sumsqs});
+        });
+        summarize(mins, maxs, sums, sumsqs, pixels, fused_stats);
+
+        // The two must agree exactly: integer counts don't depend on
+        // the order we add them in.
+        // 两者必须完全一致：整数计数与相加的顺序无关。
+        for (int ch = 0; ch < 3; ch++) {
+            for (int b = 0; b < 256; b++) {
+                if (hist(b, ch) != serial_hist(b, ch)) {
+                    printf("%s: hist(%d, %d) = %u instead of %u\n",
+                           s.name, b, ch, hist(b, ch), serial_hist(b, ch));
+                    return -1;
+                }
+            }
+        }
+        if (!same(serial_stats, fused_stats)) {
+            printf("%s: fused statistics differ from the serial ones\n", s.name);
+            return -1;
+        }
+
+        printf("%s: image + statistics, two serial passes %.2f ms, fused parallel %.2f ms\n",
+               s.name, t_two_pass * 1e3, t_fused * 1e3);
+        for (int ch = 0; ch < 3; ch++) {
+            printf("  channel %d: min %3d max %3d mean %7.3f variance %9.3f\n",
+                   ch, fused_stats[ch].min, fused_stats[ch].max,
+                   fused_stats[ch].mean, fused_stats[ch].variance);
+        }
+    }
+
+    // The histogram update itself doesn't vectorize: two lanes can
+    // land in the same bin. That's why the partial histograms are per
+    // strip rather than per vector lane. The per-bin work around it -
+    // clearing, merging partials, and the statistics - does vectorize,
+    // and it is tiny anyway.
+    // 直方图的更新本身不能向量化：两个通道可能落到同一个桶里。所以局部直方图按条带划分，而不是按向量通道
+    // 划分。它周围逐桶的工作（清零、合并局部直方图和计算统计量）可以向量化，而且计算量很小。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,187 @@
+// Halide tutorial lesson 21: Fusing the brighten and the blur into one pipeline
+// Halide入门教程第二十一课：把提亮和模糊融合成一个流水线
+
+// Lesson 2 brightens an image and lesson 7 blurs one, each loading a
+// PNG, running one operation and saving a PNG. Chaining them through
+// files is the slowest possible way to combine them, and chaining them
+// through a full-frame Buffer is only a little better: the brightened
+// frame is written out to memory in full, then read back in full by
+// the blur. Here the brightened image is just another Func in the blur
+// pipeline, computed one tile at a time right where the blur needs it,
+// so it never exists as a whole frame.
+// 第二课提亮图像，第七课模糊图像，每课都是读入一个PNG，执行一个操作，保存一个PNG。通过文件把它们串起来
+// 是最慢的组合方式，通过一个整帧的Buffer串起来也只是稍好一些：提亮后的整帧图像要完整地写入内存，再被
+// 模糊完整地读回来。本课把提亮后的图像作为模糊流水线中的另一个Func，在模糊需要的地方逐块计算，
+// 它从来不会作为整帧图像存在。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_21*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide `libpng-config --cflags --ldflags` -ljpeg -lpthread -ldl -o lesson_21
+// LD_LIBRARY_PATH=../bin ./lesson_21
+
+#include "Halide.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "halide_benchmark.h"
+#include "halide_image_io.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+static const int kTileW = 256, kTileH = 32;
+
+// The brighten from lesson 2, over an ImageParam.
+// 第二课的提亮，输入为ImageParam。
+static Func make_brighter(ImageParam input, const std::string &name) {
+    Var x("x"), y("y"), c("c");
+    Func brighter(name);
+    brighter(x, y, c) = cast<uint8_t>(min(input(x, y, c) * 1.5f, 255.0f));
+    return brighter;
+}
+
+// The clamped blur from lesson 7, over any source Func. The source
+// must be clamped to the image so that the fused pipeline treats the
+// edges exactly as the blur of a brightened Buffer would.
+// 第七课带边界条件的模糊，输入可以是任意的Func。source需要被限制在图像范围内，这样融合后的流水线
+// 对边缘的处理与对提亮后的Buffer做模糊完全相同。
+struct Blur {
+    Func input_16, blur_x, blur_y, output;
+    Var x, y, c;
+
+    Blur(Func clamped, const std::string &name)
+        : input_16(name + "_input_16"), blur_x(name + "_blur_x"),
+          blur_y(name + "_blur_y"), output(name), x("x"), y("y"), c("c") {
+        input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+        blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+        blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+        output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+    }
+};
+
+int main(int argc, char **argv) {
+    // The two-pass version: two pipelines, with a full-frame buffer
+    // in between.
+    // 两遍的版本：两个流水线，中间是一个整帧的buffer。
+    ImageParam input(UInt(8), 3, "input");
+    Func brighter = make_brighter(input, "brighter");
+    Var x = brighter.args()[0], y = brighter.args()[1], c = brighter.args()[2];
+    Var xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    brighter.reorder(x, y, c).split(y, yo, yi, kTileH).parallel(yo).vectorize(x, 16);
+
+    ImageParam brightened(UInt(8), 3, "brightened");
+    Blur second_pass(BoundaryConditions::repeat_edge(brightened), "blur");
+    second_pass.output.reorder(x, y, c).split(y, yo, yi, kTileH).parallel(yo).vectorize(x, 16);
+    second_pass.blur_x.store_at(second_pass.output, yo).compute_at(second_pass.output, yi).vectorize(x, 16);
+
+    // The fused version. repeat_edge needs explicit bounds when the
+    // thing it wraps is a Func rather than an image: we use the input's.
+    // 融合的版本。repeat_edge包裹的是Func而不是图像时，需要显式给出边界，这里使用输入的边界。
+    Func brighter_tile = make_brighter(input, "brighter_tile");
+    Func clamped = BoundaryConditions::repeat_edge(brighter_tile,
+                                                   {{input.dim(0).min(), input.dim(0).extent()},
+                                                    {input.dim(1).min(), input.dim(1).extent()}});
+    Blur fused(clamped, "fused");
+
+    // Tiles of 256x32 pixels in parallel, with all three channels of a
+    // tile done before moving on. The brightened tile (258x34x3 bytes,
+    // with the blur's one-pixel border) and the blur_x tile next to it
+    // are small enough to stay in L2 between being written and read.
+    // 以256x32像素的块并行，一个块的三个通道都算完再处理下一个块。提亮后的块（加上模糊需要的一个像素的边，
+    // 258x34x3字节）以及旁边的blur_x块都足够小，从写入到读取期间一直留在L2中。
+    fused.output.tile(x, y, xo, yo, xi, yi, kTileW, kTileH)
+        .reorder(xi, yi, c, xo, yo)
+        .parallel(yo)
+        .vectorize(xi, 16);
+    fused.blur_x.compute_at(fused.output, xo).vectorize(x, 16);
+    brighter_tile.compute_at(fused.output, xo).vectorize(x, 16);
+
+    brighter.compile_jit();
+    second_pass.output.compile_jit();
+    fused.output.compile_jit();
+
+    // The real workflow: one PNG in, one PNG out, no files in between.
+    // 实际的工作流程：读入一个PNG，输出一个PNG，中间没有文件。
+    {
+        Buffer<uint8_t> parrot = load_image("images/rgb.png");
+        input.set(parrot);
+        Buffer<uint8_t> result = fused.output.realize(parrot.width(), parrot.height(), 3);
+        save_image(result, "brighter_blurry_parrot.png");
+    }
+
+    // For timing, a 4K frame.
+    // 计时使用一帧4K图像。
+    const int width = 3840, height = 2160;
+    Buffer<uint8_t> frame(width, height, 3);
+    fill_synthetic(frame);
+    input.set(frame);
+
+    Buffer<uint8_t> intermediate(width, height, 3);
+    Buffer<uint8_t> two_pass_out(width, height, 3), fused_out(width, height, 3);
+    brightened.set(intermediate);
+
+    double t_two_pass = benchmark(10, 1, [&]() {
+        brighter.realize(intermediate);
+        second_pass.output.realize(two_pass_out);
+    });
+    double t_fused = benchmark(10, 1, [&]() { fused.output.realize(fused_out); });
+
+    // Both ways of computing it must agree exactly.
+    // 两种计算方式的结果必须完全一致。
+    if (memcmp(two_pass_out.data(), fused_out.data(), fused_out.size_in_bytes()) != 0) {
+        for (int ch = 0; ch < 3; ch++) {
+            for (int py = 0; py < height; py++) {
+                for (int px = 0; px < width; px++) {
+                    if (fused_out(px, py, ch) != two_pass_out(px, py, ch)) {
+                        printf("fused_out(%d, %d, %d) = %d instead of %d\n",
+                               px, py, ch, fused_out(px, py, ch), two_pass_out(px, py, ch));
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    // Estimated traffic to main memory. A frame is 3 * width * height
+    // bytes, far bigger than any cache, so every full-frame read or
+    // write goes to DRAM, and a store to a line not in cache costs a
+    // read of that line too (write-allocate). The tile-sized
+    // intermediates of the fused pipeline never leave the cache.
+    //   two pass: read input, write + allocate intermediate,
+    //             read intermediate, write + allocate output = 6 frames
+    //   fused:    read input, write + allocate output        = 3 frames
+    // Lesson 14 shows how to measure this with the LLC miss counters.
+    // 估算的内存流量。一帧是3 * width * height字节，远大于任何缓存，所以每次整帧的读写都会访问DRAM，
+    // 写入不在缓存中的行还需要先读入这一行（写分配）。融合流水线中块大小的中间结果从不离开缓存。
+    //   两遍：读输入，写（加写分配）中间结果，读中间结果，写（加写分配）输出 = 6帧
+    //   融合：读输入，写（加写分配）输出 = 3帧
+    // 第十四课介绍了如何用LLC缺失计数器实际测量这些流量。
+    const double frame_bytes = 3.0 * width * height;
+    const double two_pass_bytes = 6 * frame_bytes, fused_bytes = 3 * frame_bytes;
+    const double megapixels = (double)width * height / 1e6;
+
+    printf("%-10s %10s %12s %14s %12s\n", "", "time", "Mpixels/s", "est. traffic", "GB/s");
+    printf("%-10s %7.2f ms %12.1f %11.1f MB %12.2f\n", "two pass",
+           t_two_pass * 1e3, megapixels / t_two_pass, two_pass_bytes / 1e6,
+           two_pass_bytes / t_two_pass / 1e9);
+    printf("%-10s %7.2f ms %12.1f %11.1f MB %12.2f\n", "fused",
+           t_fused * 1e3, megapixels / t_fused, fused_bytes / 1e6,
+           fused_bytes / t_fused / 1e9);
+    printf("fused is %.2fx faster, and needs no %.1f MB intermediate frame\n",
+           t_two_pass / t_fused, frame_bytes / 1e6);
+
+    // Both stages are cheap per byte, so the two-pass version spends
+    // most of its time moving the intermediate frame through DRAM, and
+    // halving the traffic comes close to halving the time. What fusion
+    // costs is a little recomputation: each tile brightens a one-pixel
+    // border that the neighbouring tile brightens too, about 7% extra
+    // brightening for 256x32 tiles. Brightening is cheap, so that's a
+    // good trade; for an expensive first stage, use larger tiles.
+    // 两个阶段每字节的计算量都很小，所以两遍的版本大部分时间都花在通过DRAM搬运中间帧上，流量减半几乎
+    // 就是时间减半。融合的代价是少量的重复计算：每个块都会提亮一圈一个像素宽的边，相邻的块也会提亮这些
+    // 像素，对于256x32的块大约多出7%的提亮计算。提亮很廉价，这个交换是值得的；如果第一个阶段代价很高，
+    // 就应该使用更大的块。
+
+    printf("Success!\n");
+    return 0;
+}
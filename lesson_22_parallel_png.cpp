@@ -0,0 +1,537 @@
+// Halide tutorial lesson 22: Encoding and decoding PNGs in parallel
+// Halide入门教程第二十二课：并行编码和解码PNG
+
+// Lessons 2 and 7 save their results with save_image() from
+// halide_image_io.h, which hands the image to libpng on one thread.
+// For a multi-megapixel frame the deflate compression inside it takes
+// longer than the Halide pipeline that made the image. Deflate is
+// inherently serial within a stream, but a zlib stream can be cut into
+// pieces that don't refer to each other: that's what Z_FULL_FLUSH
+// does. So we split the image into bands of rows, compress each band
+// on its own thread, and stitch the pieces into one ordinary PNG that
+// any decoder can read. A small private chunk records where each band
+// starts, so our own decoder can inflate the bands in parallel too,
+// straight into a preallocated Halide::Buffer.
+// 第二课和第七课用halide_image_io.h中的save_image()保存结果，它在一个线程中把图像交给libpng。
+// 对于几百万像素的图像，其中的deflate压缩比生成图像的Halide流水线还要慢。一个deflate流内部本质上是串行的，
+// 但zlib流可以被切成互不引用的几段：这正是Z_FULL_FLUSH的作用。所以我们把图像分成若干行带，每个行带在
+// 自己的线程中压缩，再把各段拼接成一个任何解码器都能读取的普通PNG。一个小的私有数据块记录每个行带的
+// 起始位置，这样我们自己的解码器也可以并行地解压各个行带，直接写入预先分配好的Halide::Buffer。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_22*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide `libpng-config --cflags --ldflags` -ljpeg -lz -lpthread -ldl -o lesson_22
+// LD_LIBRARY_PATH=../bin ./lesson_22
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "halide_benchmark.h"
+#include "halide_image_io.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Run f(0) ... f(n - 1) on up to one thread per core.
+// 在最多每核一个线程上运行f(0) ... f(n - 1)。
+template<typename F>
+static void parallel_for(int n, F f) {
+    int threads = std::min(n, std::max(1, (int)std::thread::hardware_concurrency()));
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (int i = next++; i < n; i = next++) f(i);
+        });
+    }
+    for (std::thread &t : workers) t.join();
+}
+
+// PNG stores all integers big-endian.
+// PNG中的整数都是大端序。
+static void put_u32(std::vector<uint8_t> &v, uint32_t x) {
+    v.push_back(x >> 24);
+    v.push_back(x >> 16);
+    v.push_back(x >> 8);
+    v.push_back(x);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static const uint8_t kSignature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+
+// The private chunk holding the band layout. By the PNG naming rules,
+// lower case 'h' makes it ancillary (other decoders may ignore it),
+// lower case 'l' makes it private, and upper case 'D' makes it unsafe
+// to copy: an editor that rewrites the pixels must drop it, because
+// the offsets would no longer be right.
+// 记录行带布局的私有数据块。按照PNG的命名规则，小写'h'表示辅助块（其他解码器可以忽略），小写'l'表示
+// 私有块，大写'D'表示不可安全复制：修改像素的编辑器必须丢弃它，因为偏移量不再正确。
+static const char kBandChunk[5] = "hlBD";
+static const uint32_t kBandVersion = 1;
+
+static uint32_t chunk_crc(const char *type, const uint8_t *data, size_t size) {
+    uLong crc = crc32(0, (const Bytef *)type, 4);
+    return crc32(crc, data, size);
+}
+
+static void write_chunk(FILE *f, const char *type, const uint8_t *data, size_t size, uint32_t crc) {
+    std::vector<uint8_t> header;
+    put_u32(header, (uint32_t)size);
+    header.insert(header.end(), type, type + 4);
+    fwrite(header.data(), 1, header.size(), f);
+    fwrite(data, 1, size, f);
+    std::vector<uint8_t> trailer;
+    put_u32(trailer, crc);
+    fwrite(trailer.data(), 1, trailer.size(), f);
+}
+
+static int channels_of(const Buffer<uint8_t> &im) {
+    return im.dimensions() == 3 ? im.channels() : 1;
+}
+
+// One band of rows, as the encoder and decoder see it.
+// 编码器和解码器眼中的一个行带。
+struct Band {
+    int y0, y1;
+    // Filtered scanlines: one filter byte, then the interleaved pixels.
+    // 滤波后的扫描行：一个滤波类型字节，后面是交错排列的像素。
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> compressed;
+    uLong adler;
+    uint32_t crc;
+    bool ok;
+};
+
+// Filter and compress one band. Row y of the PNG is interleaved from
+// the planar Halide buffer. Most rows use the Up filter (subtract the
+// row above), which suits photographic content, but the first row of
+// each band uses Sub (subtract the pixel to the left) so that a
+// decoder can start a band without having decoded the one before it.
+// Each band is its own raw deflate stream: it can't refer back into
+// the previous band, and all but the last end with a full flush, which
+// byte-aligns the output so the pieces can simply be concatenated.
+// 对一个行带滤波并压缩。PNG的第y行由平面排列的Halide buffer交错得到。大多数行使用Up滤波（减去上一行），
+// 适合照片类内容，但每个行带的第一行使用Sub滤波（减去左边的像素），这样解码器不需要先解码前一个行带就
+// 可以开始解码这个行带。每个行带是一个独立的raw deflate流：它不能引用前一个行带，而且除最后一个之外
+// 都以full flush结束，输出按字节对齐，各段可以直接拼接。
+static void encode_band(const Buffer<uint8_t> &im, Band &band, bool last, int level) {
+    const int width = im.width(), ch = channels_of(im);
+    const size_t row_bytes = (size_t)width * ch, stride = 1 + row_bytes;
+    const int sx = im.dim(0).stride(), sy = im.dim(1).stride();
+    const int sc = ch > 1 ? im.dim(2).stride() : 0;
+
+    band.raw.resize(stride * (band.y1 - band.y0));
+    std::vector<uint8_t> cur(row_bytes), prev(row_bytes);
+    for (int y = band.y0; y < band.y1; y++) {
+        for (int c = 0; c < ch; c++) {
+            const uint8_t *src = im.data() + (size_t)y * sy + (size_t)c * sc;
+            for (int x = 0; x < width; x++) {
+                cur[(size_t)x * ch + c] = src[(size_t)x * sx];
+            }
+        }
+        uint8_t *out = &band.raw[stride * (y - band.y0)];
+        if (y == band.y0) {
+            out[0] = 1;  // Sub
+            for (size_t i = 0; i < row_bytes; i++) {
+                out[1 + i] = cur[i] - (i >= (size_t)ch ? cur[i - ch] : 0);
+            }
+        } else {
+            out[0] = 2;  // Up
+            for (size_t i = 0; i < row_bytes; i++) {
+                out[1 + i] = cur[i] - prev[i];
+            }
+        }
+        std::swap(cur, prev);
+    }
+    band.adler = adler32(adler32(0, Z_NULL, 0), band.raw.data(), band.raw.size());
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // Negative window bits: raw deflate, with no zlib header or
+    // checksum. We write those once for the whole image.
+    // 负的窗口位数：raw deflate，没有zlib头和校验和，它们由整幅图像统一写一次。
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        band.ok = false;
+        return;
+    }
+    // deflateBound assumes Z_FINISH; a full flush adds an empty
+    // stored block of a few bytes on top of that.
+    // deflateBound假设使用Z_FINISH；full flush还会额外增加一个几个字节的空存储块。
+    band.compressed.resize(deflateBound(&zs, band.raw.size()) + 64);
+    zs.next_in = band.raw.data();
+    zs.avail_in = (uInt)band.raw.size();
+    zs.next_out = band.compressed.data();
+    zs.avail_out = (uInt)band.compressed.size();
+    int ret = deflate(&zs, last ? Z_FINISH : Z_FULL_FLUSH);
+    band.ok = (ret == (last ? Z_STREAM_END : Z_OK)) && zs.avail_in == 0 && zs.avail_out > 0;
+    band.compressed.resize(band.compressed.size() - zs.avail_out);
+    deflateEnd(&zs);
+
+    band.crc = chunk_crc("IDAT", band.compressed.data(), band.compressed.size());
+    // The filtered rows aren't needed once compressed.
+    // 压缩完成后就不再需要滤波后的行。
+    std::vector<uint8_t>().swap(band.raw);
+}
+
+// Save an 8-bit image (gray, gray + alpha, RGB or RGBA) as a PNG,
+// compressing bands of rows in parallel. Returns false on failure.
+// 把8位图像（灰度、灰度+alpha、RGB或RGBA）保存为PNG，并行压缩各个行带。失败时返回false。
+bool save_png_parallel(const Buffer<uint8_t> &im, const std::string &filename, int level = 6) {
+    const int width = im.width(), height = im.height(), ch = channels_of(im);
+    static const uint8_t color_types[] = {0, 0, 4, 2, 6};
+    if (ch < 1 || ch > 4 || width <= 0 || height <= 0) return false;
+
+    // A couple of bands per core keeps the threads balanced, and the
+    // compression ratio barely notices: each band still spans hundreds
+    // of kilobytes of a large image.
+    // 每个核两个行带可以让线程负载均衡，对压缩率几乎没有影响：对于大图，每个行带仍有几百KB。
+    int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    int rows_per_band = (height + 2 * threads - 1) / (2 * threads);
+    int bands = (height + rows_per_band - 1) / rows_per_band;
+
+    std::vector<Band> parts(bands);
+    for (int i = 0; i < bands; i++) {
+        parts[i].y0 = i * rows_per_band;
+        parts[i].y1 = std::min(height, (i + 1) * rows_per_band);
+    }
+    parallel_for(bands, [&](int i) { encode_band(im, parts[i], i == bands - 1, level); });
+
+    // The checksum of the whole stream is the combination of the
+    // per-band checksums, without another pass over the data.
+    // 整个流的校验和由各行带的校验和组合得到，不需要再遍历一遍数据。
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (const Band &b : parts) {
+        if (!b.ok) return false;
+        adler = adler32_combine(adler, b.adler, (z_off_t)(b.y1 - b.y0) * (1 + (z_off_t)width * ch));
+    }
+
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) return false;
+    fwrite(kSignature, 1, sizeof(kSignature), f);
+
+    std::vector<uint8_t> ihdr;
+    put_u32(ihdr, width);
+    put_u32(ihdr, height);
+    ihdr.push_back(8);               // bit depth
+    ihdr.push_back(color_types[ch]);
+    ihdr.push_back(0);               // deflate
+    ihdr.push_back(0);               // adaptive filtering
+    ihdr.push_back(0);               // not interlaced
+    write_chunk(f, "IHDR", ihdr.data(), ihdr.size(), chunk_crc("IHDR", ihdr.data(), ihdr.size()));
+
+    // version, rows per band, band count, then the compressed size of
+    // each band. The decoder finds band i by adding up the sizes of
+    // the ones before it, after the 2-byte zlib header.
+    // 版本号、每个行带的行数、行带数，然后是每个行带压缩后的大小。解码器在2字节的zlib头之后，把前面
+    // 各行带的大小相加就能找到第i个行带。
+    std::vector<uint8_t> layout;
+    put_u32(layout, kBandVersion);
+    put_u32(layout, rows_per_band);
+    put_u32(layout, bands);
+    for (const Band &b : parts) put_u32(layout, (uint32_t)b.compressed.size());
+    write_chunk(f, kBandChunk, layout.data(), layout.size(),
+                chunk_crc(kBandChunk, layout.data(), layout.size()));
+
+    // The image data may be split across any number of consecutive
+    // IDAT chunks, so each band gets its own, with the zlib header
+    // before them and the checksum after.
+    // 图像数据可以分布在任意多个连续的IDAT块中，所以每个行带有自己的IDAT块，前面是zlib头，后面是校验和。
+    const uint8_t zlib_header[2] = {0x78, 0x9c};
+    write_chunk(f, "IDAT", zlib_header, 2, chunk_crc("IDAT", zlib_header, 2));
+    for (const Band &b : parts) {
+        write_chunk(f, "IDAT", b.compressed.data(), b.compressed.size(), b.crc);
+    }
+    std::vector<uint8_t> checksum;
+    put_u32(checksum, (uint32_t)adler);
+    write_chunk(f, "IDAT", checksum.data(), checksum.size(), chunk_crc("IDAT", checksum.data(), 4));
+    write_chunk(f, "IEND", nullptr, 0, chunk_crc("IEND", nullptr, 0));
+
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
+
+// Undo the PNG filter of one row in place. 'prev' is the previous
+// row, already unfiltered, or null for the first row of a band.
+// 就地撤销一行的PNG滤波。'prev'是已经撤销滤波的上一行，对于行带的第一行为null。
+static bool unfilter_row(uint8_t type, uint8_t *row, const uint8_t *prev, size_t n, int bpp) {
+    switch (type) {
+    case 0:
+        return true;
+    case 1:
+        for (size_t i = bpp; i < n; i++) row[i] += row[i - bpp];
+        return true;
+    case 2:
+        if (!prev) return false;
+        for (size_t i = 0; i < n; i++) row[i] += prev[i];
+        return true;
+    case 3:
+        if (!prev) return false;
+        for (size_t i = 0; i < n; i++) {
+            int left = i >= (size_t)bpp ? row[i - bpp] : 0;
+            row[i] += (uint8_t)((left + prev[i]) / 2);
+        }
+        return true;
+    case 4:
+        if (!prev) return false;
+        for (size_t i = 0; i < n; i++) {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+            int b = prev[i];
+            int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+            int p = a + b - c;
+            int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+            row[i] += (uint8_t)((pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool decode_band(const uint8_t *data, size_t size, Band &band, Buffer<uint8_t> &out) {
+    const int width = out.width(), ch = channels_of(out);
+    const size_t row_bytes = (size_t)width * ch, stride = 1 + row_bytes;
+    band.raw.resize(stride * (band.y1 - band.y0));
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) return false;
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)size;
+    zs.next_out = band.raw.data();
+    zs.avail_out = (uInt)band.raw.size();
+    int ret = inflate(&zs, Z_SYNC_FLUSH);
+    inflateEnd(&zs);
+    if ((ret != Z_OK && ret != Z_STREAM_END) || zs.avail_out != 0) return false;
+    band.adler = adler32(adler32(0, Z_NULL, 0), band.raw.data(), band.raw.size());
+
+    const int sx = out.dim(0).stride(), sy = out.dim(1).stride();
+    const int sc = ch > 1 ? out.dim(2).stride() : 0;
+    for (int y = band.y0; y < band.y1; y++) {
+        uint8_t *row = &band.raw[stride * (y - band.y0)];
+        const uint8_t *prev = y > band.y0 ? row - stride + 1 : nullptr;
+        if (!unfilter_row(row[0], row + 1, prev, row_bytes, ch)) return false;
+        for (int c = 0; c < ch; c++) {
+            uint8_t *dst = out.data() + (size_t)y * sy + (size_t)c * sc;
+            for (int x = 0; x < width; x++) {
+                dst[(size_t)x * sx] = row[1 + (size_t)x * ch + c];
+            }
+        }
+    }
+    std::vector<uint8_t>().swap(band.raw);
+    return true;
+}
+
+// Fall back to the serial path for PNGs we didn't write.
+// 不是我们写的PNG，退回到串行的读取方式。
+static bool load_fallback(const std::string &filename, Buffer<uint8_t> &out) {
+    Buffer<uint8_t> im = load_image(filename);
+    if (im.width() != out.width() || im.height() != out.height() ||
+        channels_of(im) != channels_of(out)) {
+        return false;
+    }
+    out.copy_from(im);
+    return true;
+}
+
+// Load a PNG into a preallocated buffer of the right size. PNGs
+// written by save_png_parallel are decoded one band per task; anything
+// else goes through load_image. Returns false on failure.
+// 把PNG读入一个预先分配好的、尺寸正确的buffer。由save_png_parallel写出的PNG每个行带一个任务并行解码，
+// 其他PNG通过load_image读取。失败时返回false。
+bool load_png_parallel(const std::string &filename, Buffer<uint8_t> &out) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    std::vector<uint8_t> file(file_size > 0 ? file_size : 0);
+    bool read_ok = fread(file.data(), 1, file.size(), f) == file.size();
+    fclose(f);
+    if (!read_ok || file.size() < 8 || memcmp(file.data(), kSignature, 8) != 0) return false;
+
+    // Walk the chunks. We skip CRC checks: the adler32 over the
+    // decompressed data below catches corrupt image data anyway.
+    // 遍历各个数据块。这里跳过CRC检查：下面对解压后数据的adler32校验同样可以发现损坏的图像数据。
+    const uint8_t *ihdr = nullptr, *layout = nullptr;
+    size_t layout_size = 0;
+    std::vector<uint8_t> stream;
+    for (size_t pos = 8; pos + 12 <= file.size();) {
+        uint32_t size = get_u32(&file[pos]);
+        const char *type = (const char *)&file[pos + 4];
+        const uint8_t *data = &file[pos + 8];
+        if (pos + 12 + (size_t)size > file.size()) return false;
+        if (!memcmp(type, "IHDR", 4) && size == 13) {
+            ihdr = data;
+        } else if (!memcmp(type, kBandChunk, 4)) {
+            layout = data;
+            layout_size = size;
+        } else if (!memcmp(type, "IDAT", 4)) {
+            stream.insert(stream.end(), data, data + size);
+        } else if (!memcmp(type, "IEND", 4)) {
+            break;
+        }
+        pos += 12 + (size_t)size;
+    }
+
+    static const int channels_for_type[] = {1, 0, 3, 0, 2, 0, 4};
+    if (!ihdr || !layout || layout_size < 12 || get_u32(layout) != kBandVersion ||
+        ihdr[8] != 8 || ihdr[9] > 6 || ihdr[12] != 0) {
+        return load_fallback(filename, out);
+    }
+    const int width = get_u32(ihdr), height = get_u32(ihdr + 4);
+    const int ch = channels_for_type[ihdr[9]];
+    if (width != out.width() || height != out.height() || ch != channels_of(out)) return false;
+
+    const int rows_per_band = get_u32(layout + 4), bands = get_u32(layout + 8);
+    if (rows_per_band <= 0 || bands <= 0 || layout_size != 12 + 4 * (size_t)bands ||
+        (height + rows_per_band - 1) / rows_per_band != bands) {
+        return load_fallback(filename, out);
+    }
+
+    std::vector<Band> parts(bands);
+    std::vector<size_t> offsets(bands + 1);
+    offsets[0] = 2;  // after the zlib header
+    for (int i = 0; i < bands; i++) {
+        parts[i].y0 = i * rows_per_band;
+        parts[i].y1 = std::min(height, (i + 1) * rows_per_band);
+        offsets[i + 1] = offsets[i] + get_u32(layout + 12 + 4 * i);
+    }
+    if (offsets[bands] + 4 != stream.size()) return false;
+
+    parallel_for(bands, [&](int i) {
+        parts[i].ok = decode_band(&stream[offsets[i]], offsets[i + 1] - offsets[i], parts[i], out);
+    });
+
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (const Band &b : parts) {
+        if (!b.ok) return false;
+        adler = adler32_combine(adler, b.adler, (z_off_t)(b.y1 - b.y0) * (1 + (z_off_t)width * ch));
+    }
+    return adler == get_u32(&stream[offsets[bands]]);
+}
+
+static long file_size(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static bool same(const Buffer<uint8_t> &a, const Buffer<uint8_t> &b) {
+    bool ok = true;
+    a.for_each_element([&](int x, int y, int c) {
+        if (a(x, y, c) != b(x, y, c)) ok = false;
+    });
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    struct Case {
+        const char *name;
+        int width, height;
+    };
+    Case cases[] = {{"4K", 3840, 2160}, {"8K", 7680, 4320}};
+
+    // As in the other lessons, the brighten pipeline makes the image we
+    // save, here from the synthetic test pattern blended with a smooth
+    // gradient so that it compresses more like a photo.
+    // 与其他课程一样，由提亮流水线生成要保存的图像。这里的输入是合成的测试图案与平滑渐变的混合，
+    // 压缩起来更接近照片。
+    Var x("x"), y("y"), c("c");
+    ImageParam input(UInt(8), 3, "input");
+    Func brighter("brighter");
+    brighter(x, y, c) = cast<uint8_t>(min(input(x, y, c) * 1.5f, 255.0f));
+    brighter.vectorize(x, 16).parallel(y);
+    brighter.compile_jit();
+
+    printf("%-4s %-28s %10s %12s\n", "", "", "time", "file size");
+    for (const Case &k : cases) {
+        Buffer<uint8_t> source(k.width, k.height, 3);
+        source.for_each_element([&](int x, int y, int c) {
+            uint8_t pattern = synthetic_pixel(x, y, c);
+            source(x, y, c) = (uint8_t)((pattern >> 3) + (x + y + c * 40) * 140 / (k.width + k.height));
+        });
+        input.set(source);
+        Buffer<uint8_t> image = brighter.realize(k.width, k.height, 3);
+
+        std::string serial_file = std::string("lesson_22_") + k.name + "_serial.png";
+        std::string parallel_file = std::string("lesson_22_") + k.name + "_parallel.png";
+
+        double t_save_serial = benchmark(3, 1, [&]() { save_image(image, serial_file); });
+        bool saved = true;
+        double t_save_parallel = benchmark(3, 1, [&]() {
+            saved = save_png_parallel(image, parallel_file) && saved;
+        });
+        if (!saved) {
+            printf("save_png_parallel failed for %s\n", parallel_file.c_str());
+            return -1;
+        }
+
+        Buffer<uint8_t> loaded_serial;
+        double t_load_serial = benchmark(3, 1, [&]() { loaded_serial = load_image(serial_file); });
+
+        // The destination is allocated once, outside the timing loop.
+        // 目标buffer只分配一次，不计入计时。
+        Buffer<uint8_t> loaded_parallel(k.width, k.height, 3);
+        bool loaded = true;
+        double t_load_parallel = benchmark(3, 1, [&]() {
+            loaded = load_png_parallel(parallel_file, loaded_parallel) && loaded;
+        });
+        if (!loaded) {
+            printf("load_png_parallel failed for %s\n", parallel_file.c_str());
+            return -1;
+        }
+
+        // Every combination must round-trip exactly: libpng reading our
+        // file shows it is a valid PNG, and our loader reading libpng's
+        // file exercises the fallback.
+        // 每种组合都必须完全无损：libpng能读取我们的文件说明它是合法的PNG，我们的读取函数读取libpng写的
+        // 文件则检验了退回串行的路径。
+        Buffer<uint8_t> cross_serial = load_image(parallel_file);
+        Buffer<uint8_t> cross_parallel(k.width, k.height, 3);
+        if (!load_png_parallel(serial_file, cross_parallel)) {
+            printf("load_png_parallel fallback failed for %s\n", serial_file.c_str());
+            return -1;
+        }
+        if (!same(image, loaded_serial) || !same(image, loaded_parallel) ||
+            !same(image, cross_serial) || !same(image, cross_parallel)) {
+            printf("%s: a PNG round trip changed the image\n", k.name);
+            return -1;
+        }
+
+        printf("%-4s %-28s %7.1f ms %9.2f MB\n", k.name, "save_image",
+               t_save_serial * 1e3, file_size(serial_file) / 1e6);
+        printf("%-4s %-28s %7.1f ms %9.2f MB\n", k.name, "save_png_parallel",
+               t_save_parallel * 1e3, file_size(parallel_file) / 1e6);
+        printf("%-4s %-28s %7.1f ms\n", k.name, "load_image", t_load_serial * 1e3);
+        printf("%-4s %-28s %7.1f ms\n", k.name, "load_png_parallel", t_load_parallel * 1e3);
+    }
+
+    // Saving should speed up nearly with the core count: compression
+    // is almost all of the work, and the bands share nothing. The
+    // files come out a little different in size from libpng's: every
+    // band starts with an empty dictionary, and we always use the Up
+    // filter where libpng picks a filter per row. Loading gains less,
+    // since inflating was never as slow as deflating, and reading the
+    // file and the checksums stay serial.
+    // 保存的加速比应该接近核数：压缩几乎就是全部工作，而且各行带之间没有共享。文件大小与libpng写出的
+    // 略有不同：每个行带都从空字典开始，并且我们总是使用Up滤波，而libpng会为每一行选择滤波方式。
+    // 读取的提升较小，因为解压本来就比压缩快得多，而且读文件和校验和仍然是串行的。
+
+    printf("Success!\n");
+    return 0;
+}
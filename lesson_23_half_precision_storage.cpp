@@ -0,0 +1,168 @@
+// Halide tutorial lesson 23: Storing float intermediates as float16 or bfloat16
+// Halide入门教程第二十三课：用float16或bfloat16存储浮点中间结果
+
+// In lesson 8, producer.compute_root() writes the whole producer out
+// as 32-bit floats, then the consumer reads it back. At production
+// sizes that intermediate lives in DRAM, and moving it costs more than
+// computing it. The consumer only averages four neighbouring values,
+// so it rarely needs all 24 bits of a float's mantissa. This lesson
+// computes in float32 as before but stores the producer in a 16-bit
+// type, halving the bytes written and read:
+//   float16:  1 sign, 5 exponent, 10 mantissa bits. Good precision
+//             for values of moderate size, like sin(x * y).
+//   bfloat16: 1 sign, 8 exponent,  7 mantissa bits. The range of a
+//             float32 but only about 2-3 significant digits.
+// 第八课中，producer.compute_root()把整个生产者以32位float写出，然后消费者再读回来。在生产尺寸下，
+// 这个中间结果放在DRAM中，搬运它的代价比计算它还大。消费者只是对四个相邻的值求平均，很少需要float
+// 全部24位的尾数。本课仍然用float32计算，但把生产者存储为16位类型，写入和读取的字节数减半：
+//   float16：1位符号，5位指数，10位尾数。对于大小适中的值（如sin(x * y)）精度很好。
+//   bfloat16：1位符号，8位指数，7位尾数。与float32范围相同，但只有大约2-3位有效数字。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_23*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_23
+// LD_LIBRARY_PATH=../bin ./lesson_23
+
+#include "Halide.h"
+#include <stdio.h>
+#include <math.h>
+
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// The storage types we compare. Arithmetic is float32 in every case.
+// 需要比较的存储类型。所有情况下运算都使用float32。
+struct Storage {
+    const char *name;
+    Type type;
+};
+static const Storage storages[] = {
+    {"float32", Float(32)},
+    {"float16", Float(16)},
+    {"bfloat16", BFloat(16)},
+};
+
+enum Schedule { ComputeRoot, StoreRoot };
+static const char *schedule_names[] = {"compute_root", "store_root"};
+
+// The lesson 8 pipeline, with the producer stored as 'storage'. The
+// cast to the narrow type happens as the producer writes each value,
+// and the cast back to float32 as the consumer reads it.
+// 第八课的流水线，生产者以'storage'类型存储。生产者写入每个值时转换为窄类型，消费者读取时再转换回float32。
+struct Pipeline8 {
+    Func producer, consumer;
+    Var x, y;
+
+    Pipeline8(Type storage, Schedule s)
+        : producer("producer"), consumer("consumer"), x("x"), y("y") {
+        producer(x, y) = cast(storage, sin(x * y));
+        Expr p00 = cast<float>(producer(x, y));
+        Expr p01 = cast<float>(producer(x, y+1));
+        Expr p10 = cast<float>(producer(x+1, y));
+        Expr p11 = cast<float>(producer(x+1, y+1));
+        consumer(x, y) = (p00 + p01 + p10 + p11) / 4;
+
+        if (s == ComputeRoot) {
+            // The whole producer goes through memory, in parallel.
+            // 整个生产者经过内存，并行计算。
+            producer.compute_root().parallel(y).vectorize(x, 8);
+            consumer.parallel(y).vectorize(x, 8);
+        } else {
+            // Lesson 8's sliding window: storage for the producer is
+            // folded down to the two rows the consumer needs, and each
+            // row is computed just before it is needed. This has to
+            // stay serial, so that each new row can reuse the last.
+            // 第八课的滑动窗口：生产者的存储折叠成消费者需要的两行，每一行在需要之前才计算。
+            // 这必须保持串行，每一新行才能重用上一行。
+            producer.store_root().compute_at(consumer, y).vectorize(x, 8);
+            consumer.vectorize(x, 8);
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    const int width = 4096, height = 4096;
+
+    // The conversions are only fast with hardware support. On x86 the
+    // host target includes F16C when the CPU has it, and Halide then
+    // converts eight float16 values per instruction. bfloat16 needs no
+    // special instructions: it is just the top half of a float32.
+    // 只有硬件支持时转换才快。在x86上，如果CPU支持，主机目标会包含F16C，Halide每条指令可以转换8个float16。
+    // bfloat16不需要特殊指令：它就是float32的高16位。
+    Target target = get_host_target();
+    printf("Target: %s\n", target.to_string().c_str());
+
+    // The float32 reference, with the compute_root schedule.
+    // float32的参考结果，使用compute_root调度。
+    Buffer<float> reference(width, height);
+    {
+        Pipeline8 p(Float(32), ComputeRoot);
+        p.consumer.realize(reference, target);
+    }
+
+    printf("%-13s %-9s %10s %11s %14s %12s %12s\n", "schedule", "storage", "time",
+           "Mpixels/s", "intermediate", "max error", "rms error");
+
+    for (int s = 0; s < 2; s++) {
+        for (const Storage &st : storages) {
+            Pipeline8 p(st.type, (Schedule)s);
+            p.consumer.compile_jit(target);
+
+            Buffer<float> out(width, height);
+            double t = benchmark(5, 1, [&]() { p.consumer.realize(out); });
+
+            // Error against the float32 reference. With float32
+            // storage it must be zero.
+            // 与float32参考结果相比的误差。使用float32存储时必须为零。
+            double max_error = 0, sum_sq = 0;
+            for (int py = 0; py < height; py++) {
+                for (int px = 0; px < width; px++) {
+                    double e = fabs((double)out(px, py) - reference(px, py));
+                    max_error = fmax(max_error, e);
+                    sum_sq += e * e;
+                }
+            }
+            double rms = sqrt(sum_sq / ((double)width * height));
+            if (st.type == Float(32) && max_error != 0) {
+                printf("float32 storage with %s doesn't match the reference\n", schedule_names[s]);
+                return -1;
+            }
+
+            // How big the intermediate is: the whole producer for
+            // compute_root, two folded rows for store_root.
+            // 中间结果的大小：compute_root是整个生产者，store_root是折叠后的两行。
+            double rows = s == ComputeRoot ? height + 1 : 2;
+            double intermediate = rows * (width + 1) * st.type.bytes();
+
+            printf("%-13s %-9s %7.2f ms %11.1f %11.2f MB %12.2e %12.2e\n",
+                   schedule_names[s], st.name, t * 1e3, width * height / t / 1e6,
+                   intermediate / 1e6, max_error, rms);
+        }
+    }
+
+    // A 10-bit mantissa gives float16 a relative precision of about
+    // 5e-4, so values of sin() come back within about 2.5e-4; averaging
+    // four of them keeps the error around that size. bfloat16 keeps
+    // only 7 bits and is about eight times worse. Whether that is
+    // acceptable depends on the consumer: for 8-bit image output both
+    // are well below one level, but a consumer that subtracts nearly
+    // equal values would magnify the error.
+    //
+    // With compute_root, the intermediate is 64MB in float32, which
+    // has to stream through DRAM, and halving it is a clear win once
+    // the conversions are vectorized. With store_root it is two rows
+    // that already sit in L1, so the narrow type only adds conversion
+    // work. Narrow storage pays off for intermediates that don't fit
+    // in cache; for the ones that do, schedule for locality instead.
+    // float16的10位尾数给出大约5e-4的相对精度，所以sin()的值误差约在2.5e-4以内，对四个值求平均后误差
+    // 仍在这个量级。bfloat16只保留7位，误差大约是float16的八倍。能否接受取决于消费者：对于8位图像输出，
+    // 两者的误差都远小于一个灰度级，但如果消费者对几乎相等的值做减法，误差会被放大。
+    //
+    // 使用compute_root时，float32的中间结果有64MB，必须经过DRAM，一旦转换被向量化，减半的收益很明显。
+    // 使用store_root时中间结果只有两行，本来就在L1中，窄类型只会增加转换的工作。窄类型存储适用于放不进
+    // 缓存的中间结果；对于能放进缓存的，应该从局部性的角度调度。
+
+    printf("Success!\n");
+    return 0;
+}
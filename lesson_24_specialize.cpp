@@ -0,0 +1,199 @@
+// Halide tutorial lesson 24: Specialized code paths with specialize()
+// Halide入门教程第二十四课：用specialize()生成特化的代码路径
+
+// A pipeline compiled over an ImageParam must work for every size and
+// channel count, so its inner loops carry code for the general case:
+// a guarded or shifted last vector when the width isn't a multiple of
+// the vector size, and a channel loop whose trip count is only known
+// at run time. In practice our images are nearly always RGB, their
+// widths nearly always multiples of 16, and they are either large
+// frames or small thumbnails. Stage::specialize(condition) compiles
+// an extra copy of the pipeline for the case where 'condition' holds,
+// with its own schedule, and picks between the copies at run time.
+// Inside a copy, Halide also uses the condition to simplify the code.
+// 在ImageParam上编译的流水线必须适用于任何尺寸和通道数，所以内层循环中带有处理一般情况的代码：宽度
+// 不是向量长度的整数倍时需要保护或平移最后一个向量，通道循环的次数只有运行时才知道。实际上我们的图像
+// 几乎总是RGB，宽度几乎总是16的整数倍，而且要么是大帧要么是小缩略图。Stage::specialize(condition)
+// 为'condition'成立的情况额外编译一份流水线，可以有自己的调度，并在运行时选择使用哪一份。
+// 在每一份代码中，Halide还会利用这个条件来简化代码。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_24*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_24
+// LD_LIBRARY_PATH=../bin ./lesson_24
+
+#include "Halide.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+static const int kStrip = 32;
+
+// The clamped blur from lesson 7, over an ImageParam.
+// 第七课带边界条件的模糊，输入为ImageParam。
+struct Blur {
+    ImageParam input;
+    Func clamped, input_16, blur_x, blur_y, output;
+    Var x, y, c, yo, yi;
+
+    explicit Blur(const std::string &name)
+        : input(UInt(8), 3, name + "_input"), input_16(name + "_input_16"),
+          blur_x(name + "_blur_x"), blur_y(name + "_blur_y"), output(name),
+          x("x"), y("y"), c("c"), yo("yo"), yi("yi") {
+        clamped = BoundaryConditions::repeat_edge(input);
+        input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+        blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+        blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+        output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+    }
+};
+
+// Which code path a given output shape takes. The conditions here and
+// in schedule_specialized() must match, so they live side by side.
+// 给定的输出形状会走哪一条代码路径。这里的条件必须与schedule_specialized()中的一致，所以放在一起。
+static bool is_large(int w, int h) { return w >= 256 && h >= 128; }
+
+static const char *path_for(int w, int h, int channels) {
+    if (is_large(w, h) && w % 16 == 0 && channels == 3) return "large, aligned, RGB";
+    if (is_large(w, h) && w % 16 == 0) return "large, aligned";
+    if (is_large(w, h)) return "large";
+    if (w >= 16) return "small";
+    return "tiny (generic)";
+}
+
+// The generic schedule: parallel strips, vectorized, correct for any
+// size because both tails are guarded with an if.
+// 通用的调度：并行条带，向量化，因为两个方向的尾部都用if保护，所以对任何尺寸都正确。
+static void schedule_generic(Blur &b) {
+    b.output.reorder(b.x, b.y, b.c)
+        .split(b.y, b.yo, b.yi, kStrip, TailStrategy::GuardWithIf)
+        .parallel(b.yo)
+        .vectorize(b.x, 16, TailStrategy::GuardWithIf);
+    b.blur_x.store_at(b.output, b.yo).compute_at(b.output, b.yi).vectorize(b.x, 16);
+}
+
+static void schedule_specialized(Blur &b) {
+    OutputImageParam out = b.output.output_buffer();
+    Expr w = out.width(), h = out.height(), channels = out.channels();
+    Expr large = w >= 256 && h >= 128;
+    Expr aligned = w % 16 == 0;
+
+    // The part every path shares. Every path must have the loops that
+    // blur_x is computed and stored at, so the strips are split here.
+    // The per-strip check that GuardWithIf adds in y is cheap; it's the
+    // per-vector work in x that matters.
+    // 所有路径共享的部分。每条路径都必须有blur_x计算和存储所在的循环，所以在这里拆分条带。
+    // GuardWithIf在y方向上每个条带增加的检查开销很小，关键是x方向上每个向量的工作。
+    b.output.reorder(b.x, b.y, b.c)
+        .split(b.y, b.yo, b.yi, kStrip, TailStrategy::GuardWithIf);
+
+    // Specializations are tried in the order they are declared, so the
+    // most specific comes first. For an RGB frame with an aligned
+    // width: no tail at all in x - RoundUp is safe, since rounding w up
+    // to a multiple of 16 leaves it unchanged - and with the channel
+    // count known to be 3, the three channels of a vector are computed
+    // together in an unrolled loop, sharing the address arithmetic.
+    // 特化按声明的顺序依次尝试，所以最具体的放在最前面。对于宽度对齐的RGB帧：x方向完全没有尾部——RoundUp是
+    // 安全的，因为把w向上取整到16的倍数后不变——而且已知通道数为3，一个向量的三个通道在展开的循环中一起计算，
+    // 共享地址计算。
+    b.output.specialize(large && aligned && channels == 3)
+        .parallel(b.yo)
+        .vectorize(b.x, 16, TailStrategy::RoundUp)
+        .reorder(b.c, b.x, b.yi, b.yo)
+        .unroll(b.c, 3);
+
+    // Any other aligned frame, e.g. RGBA.
+    // 其他宽度对齐的帧，例如RGBA。
+    b.output.specialize(large && aligned)
+        .parallel(b.yo)
+        .vectorize(b.x, 16, TailStrategy::RoundUp);
+
+    // Large but unaligned: shift the last vector inwards (lesson 5),
+    // which costs one overlapping vector per row instead of a branch
+    // in every one.
+    // 大但没有对齐：把最后一个向量向内平移（第五课），每行只多算一个重叠的向量，而不是每个向量都有分支。
+    b.output.specialize(large)
+        .parallel(b.yo)
+        .vectorize(b.x, 16);
+
+    // A thumbnail is done faster by one thread than by waking up the
+    // pool for a handful of strips.
+    // 缩略图由一个线程计算比为几个条带唤醒线程池更快。
+    b.output.specialize(w >= 16)
+        .vectorize(b.x, 16);
+
+    // Anything narrower than one vector falls through to the shared
+    // schedule above: serial and scalar, but correct.
+    // 比一个向量还窄的图像使用上面共享的调度：串行、标量，但是正确。
+
+    b.blur_x.store_at(b.output, b.yo).compute_at(b.output, b.yi).vectorize(b.x, 16);
+}
+
+int main(int argc, char **argv) {
+    Blur generic("generic"), specialized("specialized");
+    schedule_generic(generic);
+    schedule_specialized(specialized);
+    generic.output.compile_jit();
+    specialized.output.compile_jit();
+
+    struct Case {
+        int width, height, channels;
+    };
+    Case cases[] = {
+        {3840, 2160, 3},
+        {3840, 2160, 4},
+        {3837, 2160, 3},
+        {256, 192, 3},
+        {100, 75, 3},
+        {9, 7, 3},
+    };
+
+    printf("%-16s %-20s %12s %12s %8s\n", "size", "path", "generic", "specialized", "speedup");
+    for (const Case &k : cases) {
+        Buffer<uint8_t> in(k.width, k.height, k.channels);
+        fill_synthetic(in);
+        generic.input.set(in);
+        specialized.input.set(in);
+
+        Buffer<uint8_t> out_generic(k.width, k.height, k.channels);
+        Buffer<uint8_t> out_specialized(k.width, k.height, k.channels);
+
+        // Small images finish in microseconds, so time several runs
+        // per sample.
+        // 小图只需要几微秒，所以每个样本计时多次运行。
+        int iterations = k.width * k.height < 100000 ? 100 : 1;
+        double t_generic = benchmark(10, iterations, [&]() { generic.output.realize(out_generic); });
+        double t_specialized = benchmark(10, iterations, [&]() { specialized.output.realize(out_specialized); });
+
+        // Every path must produce exactly what the generic code does.
+        // 每条路径的结果都必须与通用代码完全相同。
+        if (memcmp(out_generic.data(), out_specialized.data(), out_generic.size_in_bytes()) != 0) {
+            printf("%dx%dx%d: the '%s' path differs from the generic path\n",
+                   k.width, k.height, k.channels, path_for(k.width, k.height, k.channels));
+            return -1;
+        }
+
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%dx%d", k.width, k.height, k.channels);
+        printf("%-16s %-20s %9.3f ms %9.3f ms %7.2fx\n", size,
+               path_for(k.width, k.height, k.channels),
+               t_generic * 1e3, t_specialized * 1e3, t_generic / t_specialized);
+    }
+
+    // The biggest wins are usually at the two ends. Large aligned RGB
+    // frames lose the guard on every vector store and gain the unrolled
+    // channels. Thumbnails skip the thread pool entirely. The price is
+    // compile time and code size: each specialization is a complete
+    // copy of the pipeline, so specialize on the few shapes that
+    // actually dominate, and let the generic path catch the rest.
+    // 最大的收益通常在两端：宽度对齐的大RGB帧去掉了每次向量存储的保护，并得到展开的通道循环；缩略图完全不使用
+    // 线程池。代价是编译时间和代码大小：每个特化都是流水线的一份完整拷贝，所以只对真正占主导的几种形状做特化，
+    // 其余的交给通用路径。
+
+    printf("Success!\n");
+    return 0;
+}
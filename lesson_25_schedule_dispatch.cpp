@@ -0,0 +1,288 @@
+// Halide tutorial lesson 25: Choosing a precompiled schedule by output size
+// Halide入门教程第二十五课：按输出尺寸选择预编译的调度
+
+// Lesson 8 realizes the same producer/consumer pipeline at 4x4 and at
+// 160x160 with different schedules, and the best one depends on the
+// size. For a thumbnail, splitting the work into parallel strips just
+// pays for waking up threads that each get a few pixels, and a
+// compute_root intermediate is an allocation to save a handful of
+// sin() calls. For an 8K frame, a serial or fully inlined schedule
+// leaves most of the cores idle and recomputes the producer four
+// times. No single schedule is right for both.
+//
+// Here we compile several schedules of the one pipeline up front,
+// measure where each one stops being the fastest, and then, on every
+// call, pick a schedule from the output size using those crossover
+// points.
+// 第八课用不同的调度在4x4和160x160上realize同一个生产者/消费者流水线，最好的调度取决于尺寸。对于缩略图，
+// 把工作拆成并行条带只会付出唤醒线程的开销，而每个线程只分到几个像素；compute_root的中间结果要为节省几次
+// sin()调用而分配一次内存。对于8K的帧，串行或完全内联的调度让大部分核空闲，并且生产者要重复计算四次。
+// 没有一个调度对两者都合适。
+//
+// 本课预先编译同一个流水线的多个调度，测量每个调度在什么尺寸之后不再最快，然后每次调用时根据输出尺寸
+// 和这些分界点选择调度。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_25*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_25
+// LD_LIBRARY_PATH=../bin ./lesson_25
+
+#include "Halide.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// The lesson 8 pipeline, with one of several schedules.
+// 第八课的流水线，使用几种调度中的一种。
+enum Schedule { Inline, Vectorized, Strips, Tiles, NumSchedules };
+static const char *schedule_names[] = {"inline", "vectorized", "strips", "tiles"};
+
+// Every schedule must be correct at every size, since the dispatcher
+// can hand it anything, so the splits guard their tails with an if
+// rather than shifting them inwards: a 4x4 output has no room to
+// shift an 8-wide vector into.
+// 分派器可能把任何尺寸交给任何调度，所以每个调度都必须对所有尺寸正确。因此拆分的尾部用if保护，而不是
+// 向内平移：4x4的输出放不下一个向内平移的8宽向量。
+static Func make_pipeline(Schedule s) {
+    Var x("x"), y("y");
+    Func producer(std::string("producer_") + schedule_names[s]);
+    Func consumer(std::string("consumer_") + schedule_names[s]);
+    producer(x, y) = sin(x * y);
+    consumer(x, y) = (producer(x, y) +
+                      producer(x, y+1) +
+                      producer(x+1, y) +
+                      producer(x+1, y+1))/4;
+
+    switch (s) {
+    case Inline:
+        // Thumbnails: everything inlined into one serial scalar loop.
+        // No allocation, no threads, no vector tails.
+        // 缩略图：所有计算内联到一个串行的标量循环中。没有内存分配，没有线程，没有向量尾部。
+        break;
+    case Vectorized: {
+        // Small images: still one thread, but vectorized, with the
+        // producer computed a scanline at a time and reused by the
+        // next one, as in lesson 8.
+        // 小图像：仍然是一个线程，但是向量化，生产者每次计算一行，并被下一行重用，与第八课相同。
+        consumer.vectorize(x, 8, TailStrategy::GuardWithIf);
+        producer.store_root().compute_at(consumer, y).vectorize(x, 8);
+        break;
+    }
+    case Strips: {
+        // Lesson 8's final schedule: parallel strips with a sliding
+        // window inside each.
+        // 第八课最后的调度：并行条带，每个条带内部使用滑动窗口。
+        Var yo("yo"), yi("yi");
+        consumer.split(y, yo, yi, 16, TailStrategy::GuardWithIf)
+            .parallel(yo)
+            .vectorize(x, 8, TailStrategy::GuardWithIf);
+        producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, 8);
+        break;
+    }
+    case Tiles: {
+        // Big frames: tiles sized to keep each tile's producer in L1,
+        // in parallel over rows of tiles.
+        // 大帧：块的大小使每个块的生产者留在L1中，按块行并行。
+        Var xo("xo"), yo("yo"), xi("xi"), yi("yi");
+        consumer.tile(x, y, xo, yo, xi, yi, 128, 32, TailStrategy::GuardWithIf)
+            .parallel(yo)
+            .vectorize(xi, 8);
+        producer.compute_at(consumer, xo).vectorize(x, 8);
+        break;
+    }
+    default:
+        break;
+    }
+    return consumer;
+}
+
+// Holds one compiled pipeline per schedule and a table of crossover
+// points. Entry i of 'limits' is the largest output, in pixels, that
+// 'choice[i]' handles; anything past the last limit uses the last
+// choice.
+// 为每个调度保存一个编译好的流水线，以及一张分界点表。'limits'的第i项是'choice[i]'负责的最大输出像素数，
+// 超过最后一个分界点的使用最后一个选择。
+class ScheduleDispatcher {
+public:
+    ScheduleDispatcher() {
+        for (int s = 0; s < NumSchedules; s++) {
+            pipelines.push_back(make_pipeline((Schedule)s));
+            pipelines.back().compile_jit();
+        }
+        // Until calibrate() is called, use the schedule from lesson 8.
+        // 在调用calibrate()之前，使用第八课的调度。
+        choice.push_back(Strips);
+    }
+
+    // Time every schedule over a ladder of square sizes, and place a
+    // crossover halfway (geometrically) between adjacent sizes whose
+    // winners differ.
+    // 在一系列正方形尺寸上对每个调度计时，如果相邻两个尺寸上最快的调度不同，就在它们之间（按几何平均）
+    // 放一个分界点。
+    void calibrate(const std::vector<int> &sides) {
+        limits.clear();
+        choice.clear();
+        printf("%-10s", "size");
+        for (int s = 0; s < NumSchedules; s++) printf(" %12s", schedule_names[s]);
+        printf("   fastest\n");
+
+        int64_t prev_pixels = 0;
+        for (int side : sides) {
+            Buffer<float> out(side, side);
+            int64_t pixels = (int64_t)side * side;
+            // Enough repetitions per sample to get above timer noise.
+            // 每个样本重复足够多次，以超过计时器的噪声。
+            int iterations = (int)std::max<int64_t>(1, (1 << 20) / pixels);
+
+            Schedule best = Inline;
+            double best_time = 0;
+            printf("%4dx%-5d", side, side);
+            for (int s = 0; s < NumSchedules; s++) {
+                double t = benchmark(5, iterations, [&]() { pipelines[s].realize(out); });
+                printf(" %9.3f us", t * 1e6);
+                if (s == 0 || t < best_time) {
+                    best = (Schedule)s;
+                    best_time = t;
+                }
+            }
+            printf("   %s\n", schedule_names[best]);
+
+            if (choice.empty()) {
+                choice.push_back(best);
+            } else if (choice.back() != best) {
+                limits.push_back((int64_t)sqrt((double)prev_pixels * pixels));
+                choice.push_back(best);
+            }
+            prev_pixels = pixels;
+        }
+    }
+
+    Schedule pick(int width, int height) const {
+        int64_t pixels = (int64_t)width * height;
+        size_t i = std::lower_bound(limits.begin(), limits.end(), pixels) - limits.begin();
+        return choice[i];
+    }
+
+    void realize(Buffer<float> &out) {
+        pipelines[pick(out.width(), out.height())].realize(out);
+    }
+
+    void realize_with(Schedule s, Buffer<float> &out) {
+        pipelines[s].realize(out);
+    }
+
+    void print_table() const {
+        int64_t lo = 0;
+        for (size_t i = 0; i < choice.size(); i++) {
+            if (i < limits.size()) {
+                printf("  %10lld .. %10lld pixels: %s\n",
+                       (long long)lo, (long long)limits[i], schedule_names[choice[i]]);
+                lo = limits[i] + 1;
+            } else {
+                printf("  %10lld .. %10s pixels: %s\n", (long long)lo, "", schedule_names[choice[i]]);
+            }
+        }
+    }
+
+private:
+    std::vector<Func> pipelines;
+    std::vector<int64_t> limits;
+    std::vector<Schedule> choice;
+};
+
+int main(int argc, char **argv) {
+    ScheduleDispatcher dispatcher;
+
+    // Calibrate on this machine. The crossovers depend on the core
+    // count, the cache sizes and the thread pool's wake-up cost, so
+    // don't copy them between machines; in production, run this once
+    // at install time and save the table.
+    // 在这台机器上校准。分界点取决于核数、缓存大小和线程池的唤醒开销，所以不要在机器之间照搬；
+    // 在实际应用中，可以在安装时运行一次并保存这张表。
+    std::vector<int> sides = {4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+    dispatcher.calibrate(sides);
+    printf("\nDispatch table:\n");
+    dispatcher.print_table();
+
+    // A mixed workload, like a service that makes thumbnails, previews
+    // and full-size renders: many small requests and a few large ones.
+    // 混合负载，类似于一个同时生成缩略图、预览图和全尺寸渲染的服务：很多小请求和少量大请求。
+    struct Request {
+        int width, height, count;
+    };
+    Request workload[] = {
+        {4, 4, 2000},
+        {8, 8, 2000},
+        {64, 48, 500},
+        {160, 160, 200},
+        {640, 480, 50},
+        {1920, 1080, 10},
+        {7680, 4320, 2},
+    };
+
+    std::vector<Buffer<float>> outputs;
+    for (const Request &r : workload) outputs.emplace_back(r.width, r.height);
+
+    auto run = [&](int fixed) {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            for (int n = 0; n < workload[i].count; n++) {
+                if (fixed < 0) {
+                    dispatcher.realize(outputs[i]);
+                } else {
+                    dispatcher.realize_with((Schedule)fixed, outputs[i]);
+                }
+            }
+        }
+    };
+
+    printf("\n%-22s %10s\n", "workload", "time");
+    double best_fixed = 0;
+    for (int s = 0; s < NumSchedules; s++) {
+        double t = benchmark(3, 1, [&]() { run(s); });
+        printf("%-22s %7.1f ms\n", (std::string("always ") + schedule_names[s]).c_str(), t * 1e3);
+        if (s == 0 || t < best_fixed) best_fixed = t;
+    }
+    double t_dispatch = benchmark(3, 1, [&]() { run(-1); });
+    printf("%-22s %7.1f ms (%.2fx the best single schedule)\n", "dispatched",
+           t_dispatch * 1e3, best_fixed / t_dispatch);
+
+    // Every schedule computes the same function. They may round
+    // differently where the producer is vectorized, so compare with a
+    // small tolerance rather than exactly.
+    // 每个调度计算的是同一个函数。生产者向量化时舍入可能略有不同，所以用一个小的容差比较，而不是完全相等。
+    for (const Request &r : workload) {
+        Buffer<float> reference(r.width, r.height), out(r.width, r.height);
+        dispatcher.realize_with(Inline, reference);
+        dispatcher.realize(out);
+        for (int y = 0; y < r.height; y++) {
+            for (int x = 0; x < r.width; x++) {
+                if (fabs(out(x, y) - reference(x, y)) > 1e-5f) {
+                    printf("%dx%d with %s: out(%d, %d) = %f instead of %f\n",
+                           r.width, r.height, schedule_names[dispatcher.pick(r.width, r.height)],
+                           x, y, out(x, y), reference(x, y));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // The dispatched workload should match or beat the best fixed
+    // schedule, because it gets each size class right: the inline
+    // schedule for the thousands of tiny requests, and the tiled one
+    // for the 8K renders. Square calibration sizes are a
+    // simplification - a very wide, short image behaves differently
+    // from a square one with the same pixel count - and a second table
+    // keyed on height would handle that.
+    // 分派后的负载应该不慢于最好的固定调度，因为它为每个尺寸类别选对了调度：数千个小请求使用内联调度，
+    // 8K渲染使用分块调度。用正方形尺寸校准是一种简化——像素数相同时，很宽很矮的图像与正方形图像的表现不同——
+    // 可以再加一张按高度索引的表来处理。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,231 @@
+// Halide tutorial lesson 26: Cache-blocked transposes and column passes
+// Halide入门教程第二十六课：分块转置和按列处理
+
+// Lesson 5's gradient_col_major uses reorder(y, x) to walk the image
+// column by column. For a Func that only writes its own output that
+// costs little at 4x4, but on a large matrix every step down a column
+// jumps a whole row ahead in memory. Each cache line brought in is
+// used for one element and then thrown out before the next column
+// comes back for the rest of it. Transposes and the vertical passes
+// of separable filters need column order all the time, so this lesson
+// builds both in a cache-friendly way:
+// 1) A transpose done in L1-sized tiles, and within each tile in 8x8
+//    blocks that are loaded as eight vectors, transposed in registers,
+//    and stored as eight vectors.
+// 2) A column pass - a vertical prefix sum, where each value depends
+//    on the one above - that walks down many columns at once in
+//    vectors, instead of one column at a time.
+// 第五课的gradient_col_major用reorder(y, x)逐列遍历图像。对于4x4的图像这几乎没有代价，但在大矩阵上，
+// 沿着列每走一步，内存地址就跳过一整行。读入的每个缓存行只用到一个元素，下一列回来使用剩下的元素之前它就
+// 已经被淘汰了。转置和可分离滤波器的垂直方向计算一直都需要按列访问，所以本课以缓存友好的方式实现这两者：
+// 1) 按L1大小的块做转置，每个块内部再分成8x8的小块：读入8个向量，在寄存器中转置，再写出8个向量。
+// 2) 按列处理：垂直方向的前缀和，每个值依赖于它上面的值。一次用向量沿着多列向下走，而不是每次一列。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_26*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_26
+// LD_LIBRARY_PATH=../bin ./lesson_26
+
+#include "Halide.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// The register block: 8x8 floats is eight AVX vectors.
+// 寄存器块：8x8个float就是8个AVX向量。
+static const int kBlock = 8;
+
+// The largest power-of-two tile whose input and output together fill
+// no more than half of L1, leaving the rest for everything else.
+// 最大的2的幂次的块大小，使输入块和输出块加起来不超过L1的一半，剩下的留给其他数据。
+static int l1_tile_size() {
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (l1 <= 0) l1 = 32 * 1024;
+    int tile = kBlock;
+    while (2 * (2 * tile) * (2 * tile) * (long)sizeof(float) <= l1 / 2) tile *= 2;
+    return tile;
+}
+
+// The naive transposes, as in lesson 5: read along rows and write
+// down columns, or the other way round.
+// 朴素的转置，与第五课一样：按行读、按列写，或者反过来。
+static Func transpose_naive(ImageParam in, bool col_major) {
+    Var x("x"), y("y");
+    Func out(col_major ? "transpose_col_major" : "transpose_row_major");
+    out(x, y) = in(y, x);
+    if (col_major) {
+        out.reorder(y, x);
+    }
+    return out;
+}
+
+// The blocked transpose.
+// 分块转置
+static Func transpose_blocked(ImageParam in, int tile) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xb("xb"), yb("yb"), xi("xi"), yi("yi");
+    Func block("block"), block_transpose("block_transpose"), out("transpose_blocked");
+
+    // The algorithm, spelled out in three steps so that each can be
+    // scheduled: copy a block in, transpose it, write it out.
+    // 算法分成三步写出来，以便分别调度：读入一个小块，转置它，写出去。
+    block(x, y) = in(x, y);
+    block_transpose(x, y) = block(y, x);
+    out(x, y) = block_transpose(x, y);
+
+    // Tiles of the output sized for L1, in parallel over rows of tiles,
+    // then 8x8 blocks within each tile.
+    // 输出按L1大小分块，按块行并行，然后在每个块内分成8x8的小块。
+    out.tile(x, y, xo, yo, x, y, tile, tile)
+        .tile(x, y, xb, yb, xi, yi, kBlock, kBlock)
+        .vectorize(xi)
+        .unroll(yi)
+        .parallel(yo);
+
+    // Per 8x8 block: eight vector loads from rows of the input, ...
+    // 每个8x8小块：从输入的8行读入8个向量，……
+    block.compute_at(out, xb).vectorize(x).unroll(y);
+
+    // ... transposed in registers - vectorizing x and unrolling y of
+    // block(y, x) is what makes Halide emit the shuffles ...
+    // ……在寄存器中转置——对block(y, x)的x向量化、y展开，Halide就会生成shuffle指令……
+    block_transpose.compute_at(out, xb).vectorize(x).unroll(y);
+
+    // ... and eight vector stores to rows of the output. The block
+    // Funcs are 8x8 and compute_at the innermost block loop, so
+    // LLVM keeps them in registers and they never touch memory.
+    // ……再向输出的8行写出8个向量。这两个小块Func都是8x8，并且计算在最内层的小块循环中，LLVM会把它们
+    // 保存在寄存器中，它们从不访问内存。
+    return out;
+}
+
+// A vertical prefix sum: out(x, y) = in(x, 0) + ... + in(x, y).
+// 垂直方向的前缀和：out(x, y) = in(x, 0) + ... + in(x, y)。
+static Func column_scan(ImageParam in, bool blocked, int tile) {
+    Var x("x"), y("y"), xo("xo"), xi("xi");
+    Func scan(blocked ? "scan_blocked" : "scan_naive");
+    RDom r(1, in.height() - 1);
+    scan(x, y) = in(x, y);
+    scan(x, r) = scan(x, r - 1) + in(x, r);
+
+    if (blocked) {
+        // The scan can't be parallel or vectorized in y, but every
+        // column is independent. Split x into strips, walk down each
+        // strip one row at a time, and do a whole vector of columns at
+        // each step: now each row step reads and writes contiguous
+        // memory.
+        // 前缀和在y方向上不能并行或向量化，但每一列都是独立的。把x拆成条带，每个条带一次向下走一行，每一步
+        // 计算一整个向量的列：这样每一行的读写都是连续的内存。
+        //
+        // The default tail for a pure Var of an update is RoundUp,
+        // which would run the last strip past the right edge whenever
+        // the width isn't a multiple of the tile (1000 below). Guard
+        // it instead.
+        // 更新中纯变量的默认尾部策略是RoundUp，当宽度不是块大小的整数倍时（比如下面的1000），最后一个条带会
+        // 越过右边界。这里改为用if保护。
+        scan.vectorize(x, 8).parallel(y, 16);
+        scan.update()
+            .split(x, xo, xi, tile, TailStrategy::GuardWithIf)
+            .reorder(xi, r, xo)
+            .vectorize(xi, 8)
+            .parallel(xo);
+    }
+    // Otherwise, an update's reduction variables are its innermost
+    // loops by default, so the naive scan walks down one column at a
+    // time, exactly like reorder(y, x).
+    // 否则，更新的归约变量默认是最内层的循环，所以朴素的前缀和每次沿着一列向下走，与reorder(y, x)完全一样。
+    return scan;
+}
+
+int main(int argc, char **argv) {
+    const int tile = l1_tile_size();
+    printf("L1 tile: %dx%d floats\n", tile, tile);
+
+    ImageParam in(Float(32), 2, "in");
+    Func naive_row = transpose_naive(in, false);
+    Func naive_col = transpose_naive(in, true);
+    Func blocked = transpose_blocked(in, tile);
+    Func scan_naive = column_scan(in, false, tile);
+    Func scan_blocked = column_scan(in, true, tile);
+    naive_row.compile_jit();
+    naive_col.compile_jit();
+    blocked.compile_jit();
+    scan_naive.compile_jit();
+    scan_blocked.compile_jit();
+
+    // Square matrices. Powers of two are the worst case for the naive
+    // transpose: every element of a column maps to the same few cache
+    // sets, so the columns evict each other even while they'd fit.
+    // 正方形矩阵。2的幂次是朴素转置最差的情况：一列中的所有元素都映射到同样几个缓存组，所以即使放得下，
+    // 各列之间也会互相淘汰。
+    // 1000 isn't a multiple of any tile size, so it also checks the
+    // ragged last strip of the blocked scan.
+    // 1000不是任何块大小的整数倍，所以它也检查了分块前缀和中不完整的最后一个条带。
+    const int sizes[] = {512, 1000, 2048, 4096};
+
+    printf("\n%-10s %-22s %10s %10s\n", "size", "kernel", "time", "GB/s");
+    for (int n : sizes) {
+        // Every element holds its own index, so a transpose that puts
+        // anything in the wrong place can't match by accident. A float
+        // holds every integer below 2^24 = 4096 * 4096 exactly.
+        // 每个元素存放它自己的下标，所以把任何元素放错位置的转置都不可能碰巧结果正确。float可以精确表示
+        // 所有小于2^24 = 4096 * 4096的整数。
+        Buffer<float> input(n, n);
+        input.for_each_element([&](int x, int y) {
+            input(x, y) = (float)(y * n + x);
+        });
+        in.set(input);
+
+        // Each kernel reads and writes the matrix once.
+        // 每个内核读写矩阵各一次。
+        const double bytes = 2.0 * n * n * sizeof(float);
+        auto report = [&](const char *name, Func f, Buffer<float> &out) {
+            double t = benchmark(5, 1, [&]() { f.realize(out); });
+            printf("%4dx%-5d %-22s %7.3f ms %10.2f\n", n, n, name, t * 1e3, bytes / t / 1e9);
+        };
+
+        Buffer<float> t_row(n, n), t_col(n, n), t_blocked(n, n);
+        report("transpose, row major", naive_row, t_row);
+        report("transpose, col major", naive_col, t_col);
+        report("transpose, blocked", blocked, t_blocked);
+
+        Buffer<float> s_naive(n, n), s_blocked(n, n);
+        report("column scan, naive", scan_naive, s_naive);
+        report("column scan, blocked", scan_blocked, s_blocked);
+
+        // A transpose only moves values around, and both scans add the
+        // same values in the same order, so all must match exactly.
+        // 转置只是移动数值，两种前缀和以相同的顺序加相同的值，所以结果都必须完全一致。
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                if (t_blocked(x, y) != input(y, x) || t_row(x, y) != input(y, x) ||
+                    t_col(x, y) != input(y, x)) {
+                    printf("%dx%d: transpose(%d, %d) is wrong\n", n, n, x, y);
+                    return -1;
+                }
+                if (s_blocked(x, y) != s_naive(x, y)) {
+                    printf("%dx%d: scan_blocked(%d, %d) = %f instead of %f\n",
+                           n, n, x, y, s_blocked(x, y), s_naive(x, y));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Once the matrix outgrows the caches, both naive transposes run
+    // at a fraction of the bandwidth of the blocked one, and they fall
+    // off hardest at the power-of-two sizes. The blocked transpose
+    // reads and writes whole cache lines and stays close to a plain
+    // copy. The naive scan has the same problem and the same cure:
+    // the dependence runs down the columns, but nothing forces us to
+    // do only one column at a time.
+    // 一旦矩阵超出缓存，两种朴素转置的带宽都只有分块转置的几分之一，在2的幂次尺寸上下降得最厉害。分块转置
+    // 读写的都是完整的缓存行，速度接近普通的拷贝。朴素的前缀和有同样的问题，也有同样的解法：依赖关系沿着列
+    // 向下，但没有什么要求我们每次只处理一列。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,196 @@
+// Halide tutorial lesson 27: Software prefetching for streaming reads
+// Halide入门教程第二十七课：为流式读取加入软件预取
+
+// Once a pipeline is vectorized and parallel, a large image is often
+// limited not by arithmetic but by waiting for memory: the lesson 7
+// blur does a few adds per byte, and the lesson 8 consumer a few per
+// float. Hardware prefetchers follow simple streams well, but each
+// strip of a parallel schedule starts a new stream, and a blur reads
+// several rows at once. Func::prefetch(f, var, distance) asks Halide
+// to issue prefetch instructions at each iteration of loop 'var' for
+// the part of 'f' that iteration var + distance will read, so the
+// data is on its way to cache before it is needed.
+//
+// The right distance depends on the machine's memory latency and on
+// how long one iteration takes, so we sweep it.
+// 流水线向量化和并行化之后，大图的瓶颈常常不是计算而是等待内存：第七课的模糊每个字节只做几次加法，第八课
+// 的消费者每个float也只做几次运算。硬件预取器能很好地跟踪简单的数据流，但并行调度的每个条带都会开始一个
+// 新的数据流，而模糊同时读取好几行。Func::prefetch(f, var, distance)让Halide在循环'var'的每次迭代中，
+// 为第var + distance次迭代将要读取的'f'的部分发出预取指令，使数据在需要之前就已经在送往缓存的路上。
+//
+// 合适的距离取决于机器的内存延迟和一次迭代所需的时间，所以我们对它进行扫描。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_27*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_27
+// LD_LIBRARY_PATH=../bin ./lesson_27 [distance ...]
+
+#include "Halide.h"
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "halide_benchmark.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// The lesson 7 clamped blur, in parallel strips, with the input
+// prefetched 'distance' scanlines ahead. Distance 0 means no prefetch.
+// 第七课带边界条件的模糊，按条带并行，提前'distance'行预取输入。距离为0表示不预取。
+static Func make_blur(ImageParam input, int distance) {
+    Var x("x"), y("y"), c("c"), yo("yo"), yi("yi");
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func input_16("input_16"), blur_x("blur_x"), blur_y("blur_y"), output("blur");
+    input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+    blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+    blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+    output(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+
+    output.reorder(x, y, c).split(y, yo, yi, 32).parallel(yo).vectorize(x, 16);
+    blur_x.store_at(output, yo).compute_at(output, yi).vectorize(x, 16);
+    if (distance > 0) {
+        // Each iteration of yi reads one new input row (blur_x slides
+        // down the strip), so this fetches the row 'distance' rows
+        // below it. Near the bottom of the image the prefetched rows
+        // would be out of bounds; the default strategy guards those
+        // prefetches with an if.
+        // yi的每次迭代读取一个新的输入行（blur_x沿条带向下滑动），所以这里预取它下面第'distance'行。
+        // 在图像底部附近，预取的行会超出边界，默认的策略会用if保护这些预取。
+        output.prefetch(input, yi, distance);
+    }
+    return output;
+}
+
+// The lesson 8 consumer, reading a producer that has already been
+// computed into memory, as it would be with compute_root. The producer
+// is an input here so that we time just the streaming reads, not the
+// sin() calls.
+// 第八课的消费者，读取已经计算到内存中的生产者，就像compute_root那样。这里把生产者作为输入，
+// 这样计时的只是流式读取，而不包括sin()的计算。
+static Func make_consumer(ImageParam producer_storage, int distance) {
+    Var x("x"), y("y"), yo("yo"), yi("yi");
+    Func consumer("consumer");
+    consumer(x, y) = (producer_storage(x, y) +
+                      producer_storage(x, y+1) +
+                      producer_storage(x+1, y) +
+                      producer_storage(x+1, y+1))/4;
+
+    consumer.split(y, yo, yi, 16).parallel(yo).vectorize(x, 8);
+    if (distance > 0) {
+        consumer.prefetch(producer_storage, yi, distance);
+    }
+    return consumer;
+}
+
+int main(int argc, char **argv) {
+    // Prefetch distances in scanlines, from the command line if given.
+    // 以扫描行为单位的预取距离，如果命令行给出则使用命令行的值。
+    std::vector<int> distances = {0, 1, 2, 4, 8, 16};
+    if (argc > 1) {
+        distances = {0};
+        for (int i = 1; i < argc; i++) {
+            int d = atoi(argv[i]);
+            if (d > 0) distances.push_back(d);
+        }
+    }
+
+    const int sizes[] = {1024, 2048, 4096, 8192};
+
+    ImageParam input(UInt(8), 3, "input");
+    ImageParam producer_storage(Float(32), 2, "producer_storage");
+
+    // Compile one pipeline per distance, up front.
+    // 预先为每个距离编译一个流水线。
+    std::vector<Func> blurs, consumers;
+    for (int d : distances) {
+        blurs.push_back(make_blur(input, d));
+        blurs.back().compile_jit();
+        consumers.push_back(make_consumer(producer_storage, d));
+        consumers.back().compile_jit();
+    }
+
+    printf("%-10s %-10s", "size", "pipeline");
+    for (int d : distances) {
+        char label[32];
+        if (d) {
+            snprintf(label, sizeof(label), "d=%d", d);
+        } else {
+            snprintf(label, sizeof(label), "none");
+        }
+        printf(" %10s", label);
+    }
+    printf("   best\n");
+
+    for (int n : sizes) {
+        Buffer<uint8_t> image(n, n, 3);
+        fill_synthetic(image);
+        input.set(image);
+
+        Buffer<float> produced(n + 1, n + 1);
+        produced.for_each_element([&](int x, int y) {
+            produced(x, y) = sinf((float)x * y);
+        });
+        producer_storage.set(produced);
+
+        for (int p = 0; p < 2; p++) {
+            const char *name = p == 0 ? "blur" : "consumer";
+            printf("%5dx%-4d %-10s", n, n, name);
+
+            Buffer<uint8_t> blur_ref(n, n, 3), blur_out(n, n, 3);
+            Buffer<float> consumer_ref(n, n), consumer_out(n, n);
+
+            double best_time = 0;
+            int best_distance = 0;
+            for (size_t i = 0; i < distances.size(); i++) {
+                double t;
+                if (p == 0) {
+                    Buffer<uint8_t> &out = i == 0 ? blur_ref : blur_out;
+                    t = benchmark(10, 1, [&]() { blurs[i].realize(out); });
+                } else {
+                    Buffer<float> &out = i == 0 ? consumer_ref : consumer_out;
+                    t = benchmark(10, 1, [&]() { consumers[i].realize(out); });
+                }
+                printf(" %7.3f ms", t * 1e3);
+                if (i == 0 || t < best_time) {
+                    best_time = t;
+                    best_distance = distances[i];
+                }
+
+                // A prefetch is only a hint, and must never change the
+                // result.
+                // 预取只是一个提示，绝不能改变结果。
+                bool same = p == 0 ?
+                    memcmp(blur_ref.data(), blur_out.data(), blur_ref.size_in_bytes()) == 0 :
+                    memcmp(consumer_ref.data(), consumer_out.data(), consumer_ref.size_in_bytes()) == 0;
+                if (i > 0 && !same) {
+                    printf("\n%s at %dx%d with prefetch distance %d gave a different result\n",
+                           name, n, n, distances[i]);
+                    return -1;
+                }
+            }
+            if (best_distance) {
+                printf("   d=%d\n", best_distance);
+            } else {
+                printf("   none\n");
+            }
+        }
+    }
+
+    // At 1024x1024 everything fits in the last-level cache, and the
+    // prefetches are pure overhead. At the larger sizes a short
+    // distance typically helps a little, because the hardware
+    // prefetcher takes a while to lock on to each new strip. Too far
+    // ahead, and the prefetched rows are evicted before use, or they
+    // cross into the next strip, which belongs to another thread.
+    // Re-run the sweep when moving to a new machine, and pick the
+    // distance from the largest size you care about.
+    // 在1024x1024时所有数据都在最后一级缓存中，预取纯粹是额外开销。在更大的尺寸上，较短的距离通常能带来
+    // 一点提升，因为硬件预取器需要一段时间才能跟上每个新的条带。距离太远时，预取的行在使用之前就被淘汰，
+    // 或者越过了条带的边界进入另一个线程的条带。换一台机器时应该重新扫描，并按你关心的最大尺寸选择距离。
+
+    printf("Success!\n");
+    return 0;
+}
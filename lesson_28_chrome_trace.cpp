@@ -0,0 +1,315 @@
+// Halide tutorial lesson 28: A timeline of parallel tasks in Chrome trace format
+// Halide入门教程第二十八课：以Chrome trace格式导出并行任务的时间线
+
+// When gradient.parallel(tile_index) from lesson 5 or
+// consumer.parallel(yo) from lesson 8 runs, all we see from outside is
+// the total time. We can't see how many tasks there were, which thread
+// ran each one, whether some threads sat idle at the end, or whether
+// one slow tile held everything up. This lesson records that, using
+// two hooks from earlier lessons:
+// 1) A custom do_task handler (lesson 14), which Halide calls for
+//    every iteration of a parallel loop, to time each task and note
+//    which thread ran it.
+// 2) trace_realizations() with a custom trace handler (lesson 19), for
+//    the begin and end of each Func's produce and consume regions.
+// The result is written as Chrome trace-event JSON, which you can open
+// in https://ui.perfetto.dev or chrome://tracing to get one row per
+// thread on a timeline.
+// 运行第五课的gradient.parallel(tile_index)或第八课的consumer.parallel(yo)时，从外部只能看到总的时间。
+// 我们看不到有多少个任务、每个任务由哪个线程执行、有没有线程在最后空闲、有没有某个慢的块拖住了整体。
+// 本课利用前面课程中的两个钩子记录这些信息：
+// 1) 自定义的do_task处理函数（第十四课）：Halide为并行循环的每次迭代调用它，我们记录每个任务的时间以及
+//    由哪个线程执行。
+// 2) trace_realizations()加上自定义的跟踪函数（第十九课）：记录每个Func的produce和consume区域的开始和结束。
+// 结果写成Chrome trace-event格式的JSON，可以在https://ui.perfetto.dev或chrome://tracing中打开，
+// 在时间线上每个线程显示为一行。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_28*.cpp -g -std=c++11 -I ../include -L ../bin -lHalide -lpthread -ldl -o lesson_28
+// LD_LIBRARY_PATH=../bin ./lesson_28
+// Then open lesson_28_gradient.json and lesson_28_consumer.json in Perfetto.
+
+#include "Halide.h"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Halide;
+
+// One finished span on the timeline.
+// 时间线上一段已结束的区间。
+struct Span {
+    std::string name, category;
+    double begin_us, end_us;
+    int tid;
+    int index;  // the task index, or -1 for produce/consume spans
+};
+
+// The recorder. Halide calls the hooks from many threads at once, so
+// everything shared is behind one lock. That serializes the hooks
+// against each other, which is fine for a debugging mode: the tasks
+// themselves still run in parallel.
+// 记录器。Halide会从多个线程同时调用这些钩子，所以所有共享的数据都由一把锁保护。这会让钩子之间串行化，
+// 对于调试模式来说没有问题：任务本身仍然是并行执行的。
+static std::mutex trace_lock;
+static std::vector<Span> spans;
+static std::map<int, Span> open_spans;
+static std::atomic<int> next_event_id(1), next_tid(0);
+static std::chrono::steady_clock::time_point trace_start;
+
+static double now_us() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - trace_start).count();
+}
+
+// A small stable number per thread, in order of first appearance, so
+// the timeline rows read 0, 1, 2, ... rather than kernel thread ids.
+// 每个线程一个小的固定编号，按首次出现的顺序分配，这样时间线上的行是0, 1, 2, ...，而不是内核的线程号。
+static int this_tid() {
+    thread_local int tid = next_tid++;
+    return tid;
+}
+
+// Every iteration of every parallel loop comes through here.
+// 每个并行循环的每次迭代都经过这里。
+int tracing_do_task(void *user_context, int (*f)(void *, int, uint8_t *),
+                    int idx, uint8_t *closure) {
+    Span s;
+    s.name = "task";
+    s.category = "parallel";
+    s.tid = this_tid();
+    s.index = idx;
+    s.begin_us = now_us();
+    int result = f(user_context, idx, closure);
+    s.end_us = now_us();
+    std::lock_guard<std::mutex> lock(trace_lock);
+    spans.push_back(s);
+    return result;
+}
+
+// Produce and consume events come in begin/end pairs. Halide passes
+// the id we return for the begin event back to us as the parent_id of
+// the matching end event, which is how we pair them up.
+// produce和consume事件成对出现。我们为开始事件返回的id，Halide会作为对应结束事件的parent_id传回来，
+// 我们就靠它把两者配对。
+int tracing_trace(void *user_context, const halide_trace_event_t *e) {
+    int id = next_event_id++;
+    double t = now_us();
+    const char *category = nullptr;
+    bool begin = false;
+    switch (e->event) {
+    case halide_trace_produce:
+        begin = true;
+        // fall through
+    case halide_trace_end_produce:
+        category = "produce";
+        break;
+    case halide_trace_consume:
+        begin = true;
+        // fall through
+    case halide_trace_end_consume:
+        category = "consume";
+        break;
+    default:
+        return id;
+    }
+
+    std::lock_guard<std::mutex> lock(trace_lock);
+    if (begin) {
+        Span s;
+        s.name = std::string(category) + " " + e->func;
+        s.category = category;
+        s.tid = this_tid();
+        s.index = -1;
+        s.begin_us = t;
+        open_spans[id] = s;
+    } else {
+        auto it = open_spans.find(e->parent_id);
+        if (it != open_spans.end()) {
+            it->second.end_us = t;
+            spans.push_back(it->second);
+            open_spans.erase(it);
+        }
+    }
+    return id;
+}
+
+// Turn tracing on for a pipeline. 'traced' are the Funcs whose produce
+// and consume regions we want on the timeline.
+// 为一个流水线打开跟踪。'traced'是需要在时间线上显示produce和consume区域的Func。
+static void attach_tracer(Func output, const std::vector<Func> &traced) {
+    for (Func f : traced) f.trace_realizations();
+    output.set_custom_do_task(tracing_do_task);
+    output.set_custom_trace(tracing_trace);
+}
+
+static void reset_trace() {
+    std::lock_guard<std::mutex> lock(trace_lock);
+    spans.clear();
+    open_spans.clear();
+    trace_start = std::chrono::steady_clock::now();
+}
+
+// The Chrome trace-event format: 'X' events are complete spans with a
+// start time and a duration, both in microseconds, and 'M' events
+// give each thread row a name.
+// Chrome trace-event格式：'X'事件是带有开始时间和持续时间（都以微秒为单位）的完整区间，'M'事件为每个
+// 线程行命名。
+static bool write_chrome_trace(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) return false;
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int threads = next_tid;
+    for (int t = 0; t < threads; t++) {
+        fprintf(f, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, "
+                   "\"args\": {\"name\": \"thread %d\"}},\n", t, t);
+    }
+    for (size_t i = 0; i < spans.size(); i++) {
+        const Span &s = spans[i];
+        fprintf(f, "  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, "
+                   "\"ts\": %.3f, \"dur\": %.3f",
+                s.name.c_str(), s.category.c_str(), s.tid, s.begin_us, s.end_us - s.begin_us);
+        if (s.index >= 0) {
+            fprintf(f, ", \"args\": {\"index\": %d}", s.index);
+        }
+        fprintf(f, "}%s\n", i + 1 < spans.size() ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    return fclose(f) == 0;
+}
+
+// The numbers worth looking for on the timeline, as text: how busy
+// each thread was, and which tasks took much longer than the rest.
+// 以文本形式给出时间线上值得关注的数字：每个线程有多忙，哪些任务比其他任务慢得多。
+static void summarize(const char *name, double wall_us) {
+    std::vector<double> busy(next_tid, 0.0);
+    std::vector<const Span *> tasks;
+    for (const Span &s : spans) {
+        if (s.index < 0) continue;
+        busy[s.tid] += s.end_us - s.begin_us;
+        tasks.push_back(&s);
+    }
+    if (tasks.empty()) return;
+    std::sort(tasks.begin(), tasks.end(), [](const Span *a, const Span *b) {
+        return (a->end_us - a->begin_us) < (b->end_us - b->begin_us);
+    });
+    double median = tasks[tasks.size() / 2]->end_us - tasks[tasks.size() / 2]->begin_us;
+
+    printf("%s: %d tasks in %.2f ms, median task %.1f us\n",
+           name, (int)tasks.size(), wall_us / 1e3, median);
+    for (size_t t = 0; t < busy.size(); t++) {
+        if (busy[t] > 0) {
+            printf("  thread %2d busy %5.1f%%\n", (int)t, 100.0 * busy[t] / wall_us);
+        }
+    }
+
+    // A straggler is a task that takes more than twice the median.
+    // 掉队者是指耗时超过中位数两倍的任务。
+    int stragglers = 0;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+        double d = (*it)->end_us - (*it)->begin_us;
+        if (d <= 2 * median) break;
+        if (stragglers < 5) {
+            printf("  straggler: task %d on thread %d took %.1f us\n", (*it)->index, (*it)->tid, d);
+        }
+        stragglers++;
+    }
+    if (stragglers > 5) printf("  ... and %d more stragglers\n", stragglers - 5);
+}
+
+template<typename T>
+static bool run_traced(const char *name, Func output, Buffer<T> out, const std::string &filename) {
+    output.compile_jit();
+    // An untraced warm-up, so thread pool start-up isn't on the timeline.
+    // 先运行一次作为预热，这样线程池的启动不会出现在时间线上。
+    output.realize(out);
+
+    reset_trace();
+    double t0 = now_us();
+    output.realize(out);
+    double wall = now_us() - t0;
+
+    std::lock_guard<std::mutex> lock(trace_lock);
+    summarize(name, wall);
+    if (!write_chrome_trace(filename)) {
+        printf("Could not write %s\n", filename.c_str());
+        return false;
+    }
+    printf("  wrote %s (%d events)\n\n", filename.c_str(), (int)spans.size());
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Lesson 5's fastest gradient, over a larger image so that there
+    // are a good number of 64x64 tiles to go around.
+    // 第五课中最快的gradient，图像更大，这样有足够多的64x64块可以分配。
+    {
+        Var x("x"), y("y"), x_outer, y_outer, x_inner, y_inner, tile_index;
+        Var x_inner_outer, y_inner_outer, x_vectors, y_pairs;
+        Func gradient_fast("gradient_fast");
+        gradient_fast(x, y) = x + y;
+        gradient_fast
+            .tile(x, y, x_outer, y_outer, x_inner, y_inner, 64, 64)
+            .fuse(x_outer, y_outer, tile_index)
+            .parallel(tile_index);
+        gradient_fast
+            .tile(x_inner, y_inner, x_inner_outer, y_inner_outer, x_vectors, y_pairs, 4, 2)
+            .vectorize(x_vectors)
+            .unroll(y_pairs);
+
+        attach_tracer(gradient_fast, {gradient_fast});
+        Buffer<int> result(2048, 2048);
+        if (!run_traced("gradient_fast", gradient_fast, result, "lesson_28_gradient.json")) {
+            return -1;
+        }
+        for (int y = 0; y < result.height(); y++) {
+            for (int x = 0; x < result.width(); x++) {
+                if (result(x, y) != x + y) {
+                    printf("result(%d, %d) = %d instead of %d\n", x, y, result(x, y), x + y);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Lesson 8's final schedule: parallel strips of the consumer, with
+    // the producer computed per scanline inside each strip. Its
+    // produce/consume spans show up nested inside the task spans.
+    // 第八课最后的调度：消费者按条带并行，生产者在每个条带内按行计算。它的produce/consume区间嵌套显示在
+    // 任务区间内。
+    {
+        Var x("x"), y("y"), yo("yo"), yi("yi");
+        Func producer("producer"), consumer("consumer");
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) +
+                          producer(x, y+1) +
+                          producer(x+1, y) +
+                          producer(x+1, y+1))/4;
+        consumer.split(y, yo, yi, 16).parallel(yo).vectorize(x, 4);
+        producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, 4);
+
+        attach_tracer(consumer, {producer});
+        Buffer<float> result(1600, 1600);
+        if (!run_traced("consumer", consumer, result, "lesson_28_consumer.json")) {
+            return -1;
+        }
+    }
+
+    // In the gradient trace, each task is tiny and the rows of the
+    // timeline are packed solid, except at the very end where threads
+    // run out of tiles. In the consumer trace there are only 100
+    // strips; if that isn't a multiple of the thread count, the last
+    // round leaves some threads idle, and you can see it as a ragged
+    // right edge. Either way, the busy percentages say how much of the
+    // machine the schedule actually used.
+    // 在gradient的时间线中，每个任务都很小，各行排得很满，只有在最后线程分不到块时才有空隙。在consumer的
+    // 时间线中只有100个条带；如果它不是线程数的整数倍，最后一轮会有一些线程空闲，在时间线上表现为参差不齐的
+    // 右边缘。无论哪种情况，忙碌百分比都说明了调度实际利用了机器的多少。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Halide tutorial lesson 29: Measuring redundant recompute and choosing a tile size
+// Halide入门教程第二十九课：度量冗余计算并选择分块大小
+
+// Lesson 8's tiled schedule computes the producer over a 5x5 region
+// for every 4x4 tile of the consumer: 25 points where 16 are new, so
+// 56% of the producer work is done twice. Bigger tiles waste less, but
+// their producer regions stop fitting in cache, and with fewer tiles
+// there's less to go around the threads. Lesson 5's gradient_fast has
+// a different kind of overlap: when the image isn't a multiple of the
+// tile size, the last tile in each row and column is shifted inwards
+// and recomputes points that its neighbour already did.
+//
+// Rather than guess, this lesson asks Halide. Its bounds inference
+// decides the region of the producer each tile computes, and a trace
+// handler sees every one of those regions as it is produced. Adding
+// them up gives the exact number of points computed, which we compare
+// with the number actually needed. Then we pick the tile size that
+// wastes the least work while its producer region still fits in L1
+// and there are enough tiles for every thread.
+// 第八课的分块调度中，消费者的每个4x4块都要在5x5的区域上计算生产者：25个点中只有16个是新的，所以生产者有
+// 56%的工作做了两遍。块越大浪费越少，但生产者区域会放不进缓存，块的数量也会减少，不够分给所有线程。
+// 第五课的gradient_fast有另一种重叠：当图像不是块大小的整数倍时，每行和每列的最后一个块会向内平移，
+// 重新计算相邻块已经算过的点。
+//
+// 本课不靠猜，而是直接询问Halide。Halide的边界推断决定每个块计算生产者的哪个区域，跟踪函数可以看到生产的
+// 每一个区域。把它们加起来就得到准确的计算点数，再与实际需要的点数比较。然后选择浪费最少、同时生产者区域
+// 仍能放进L1、块的数量足够分给所有线程的分块大小。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_29*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_29
+// LD_LIBRARY_PATH=../bin ./lesson_29 [width height]
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "halide_benchmark.h"
+#include "tools/lesson_08_pipeline.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// Points counted by the trace handler below.
+// 由下面的跟踪函数统计的点数。
+static std::atomic<int64_t> produced_points(0), stored_points(0);
+static std::string counted_func;
+static std::atomic<int> next_id(1);
+
+// For a produce event, the coordinates are the min and extent of the
+// region about to be computed in each dimension - exactly what bounds
+// inference decided. For a store event, they are the stored
+// coordinates, one set per vector lane.
+// 对于produce事件，坐标是每一维上即将计算的区域的最小值和范围——正是边界推断的结果。对于store事件，
+// 坐标是写入的位置，每个向量通道一组。
+int count_points(void *user_context, const halide_trace_event_t *e) {
+    if (e->event == halide_trace_produce && counted_func == e->func) {
+        int64_t points = 1;
+        for (int d = 0; d < e->dimensions / 2; d++) {
+            points *= e->coordinates[2 * d + 1];
+        }
+        produced_points += points;
+    } else if (e->event == halide_trace_store) {
+        stored_points += e->type.lanes;
+    }
+    return next_id++;
+}
+
+// The lesson 8 pipeline. tile_w == 0 means compute_root, which
+// computes each producer point exactly once: that is our minimum.
+// 第八课的流水线。tile_w == 0表示compute_root，每个生产者点只计算一次：这就是最小值。
+struct Pipeline8 : ProducerConsumer {
+    Var xo, yo, xi, yi;
+
+    Pipeline8(int tile_w, int tile_h) : xo("xo"), yo("yo"), xi("xi"), yi("yi") {
+        if (tile_w == 0) {
+            producer.compute_root();
+        } else {
+            consumer.tile(x, y, xo, yo, xi, yi, tile_w, tile_h).parallel(yo);
+            producer.compute_at(consumer, xo);
+        }
+    }
+};
+
+// Producer points computed for one realization, counted by tracing.
+// 通过跟踪统计一次realize计算的生产者点数。
+static int64_t traced_producer_points(int width, int height, int tile_w, int tile_h) {
+    Pipeline8 p(tile_w, tile_h);
+    p.producer.trace_realizations();
+    p.consumer.set_custom_trace(count_points);
+    counted_func = "producer";
+    produced_points = 0;
+    p.consumer.realize(width, height);
+    return produced_points;
+}
+
+// The same count from a formula, to show what's going on. Along one
+// dimension there are ceil(extent / tile) tiles, and each needs the
+// tile plus a one-point border from the producer.
+// 用公式得到同样的计数，说明其中的原理。沿一个维度有ceil(extent / tile)个块，每个块需要生产者在块的
+// 基础上多一个点的边。
+static int64_t predicted_points_1d(int extent, int tile) {
+    int64_t tiles = (extent + tile - 1) / tile;
+    return tiles * (tile + 1);
+}
+
+struct Candidate {
+    int tile_w, tile_h;
+    int64_t computed, predicted;
+    double overhead;      // computed / minimum - 1
+    double working_set;   // bytes of producer per tile
+    int64_t tiles;
+};
+
+int main(int argc, char **argv) {
+    int width = 3840, height = 2160;
+    if (argc == 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    }
+
+    // Part 1: the gradient from lesson 5. 350x250 isn't a multiple of
+    // 64 in either direction, so the shifted edge tiles recompute part
+    // of their neighbours. Here we count the stores instead of produce
+    // events, because the tiles are loops over the output itself.
+    // 第一部分：第五课的gradient。350x250在两个方向上都不是64的整数倍，所以向内平移的边缘块会重新计算相邻块
+    // 的一部分。这里统计的是store事件而不是produce事件，因为这些块就是输出自身的循环。
+    {
+        Var x("x"), y("y"), x_outer, y_outer, x_inner, y_inner, tile_index;
+        Var x_inner_outer, y_inner_outer, x_vectors, y_pairs;
+        Func gradient_fast("gradient_fast");
+        gradient_fast(x, y) = x + y;
+        gradient_fast
+            .tile(x, y, x_outer, y_outer, x_inner, y_inner, 64, 64)
+            .fuse(x_outer, y_outer, tile_index)
+            .parallel(tile_index);
+        gradient_fast
+            .tile(x_inner, y_inner, x_inner_outer, y_inner_outer, x_vectors, y_pairs, 4, 2)
+            .vectorize(x_vectors)
+            .unroll(y_pairs);
+        gradient_fast.trace_stores();
+        gradient_fast.set_custom_trace(count_points);
+
+        stored_points = 0;
+        gradient_fast.realize(350, 250);
+        int64_t needed = 350 * 250;
+        printf("gradient_fast 350x250, 64x64 tiles: %lld points computed, %lld needed, %.1f%% redundant\n\n",
+               (long long)stored_points, (long long)needed,
+               100.0 * (stored_points - needed) / needed);
+    }
+
+    // Part 2: the lesson 8 producer over a sweep of tile sizes.
+    // 第二部分：在一系列分块大小上分析第八课的生产者。
+    const int64_t minimum = traced_producer_points(width, height, 0, 0);
+    const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (l1 <= 0) l1 = 32 * 1024;
+
+    printf("consumer %dx%d needs %lld producer points; %d threads, L1 %ld KB\n",
+           width, height, (long long)minimum, threads, l1 / 1024);
+    printf("%-9s %14s %14s %10s %12s %8s\n",
+           "tile", "computed", "predicted", "redundant", "tile bytes", "tiles");
+
+    std::vector<Candidate> candidates;
+    const int sizes[] = {4, 8, 16, 32, 64, 128, 256};
+    for (int tw : sizes) {
+        for (int th : sizes) {
+            // A tile can't be shifted inwards into an image smaller
+            // than itself.
+            // 块不能向内平移到比它自己还小的图像中。
+            if (tw > width || th > height) continue;
+            Candidate c;
+            c.tile_w = tw;
+            c.tile_h = th;
+            c.computed = traced_producer_points(width, height, tw, th);
+            c.predicted = predicted_points_1d(width, tw) * predicted_points_1d(height, th);
+            c.overhead = (double)c.computed / minimum - 1;
+            c.working_set = (double)(tw + 1) * (th + 1) * sizeof(float);
+            c.tiles = (int64_t)((width + tw - 1) / tw) * ((height + th - 1) / th);
+            candidates.push_back(c);
+
+            char tile[16];
+            snprintf(tile, sizeof(tile), "%dx%d", tw, th);
+            printf("%-9s %14lld %14lld %9.1f%% %12.0f %8lld\n", tile,
+                   (long long)c.computed, (long long)c.predicted, 100 * c.overhead,
+                   c.working_set, (long long)c.tiles);
+        }
+    }
+
+    // The recommendation: least redundant work, among the tiles whose
+    // producer region fits in half of L1 (the consumer's tile needs
+    // the rest) and that leave at least four tiles per thread for load
+    // balance. Between equally good tiles, prefer the wider one, since
+    // rows are contiguous in memory.
+    // 推荐的规则：在生产者区域能放进L1的一半（另一半留给消费者的块）、并且每个线程至少能分到四个块以保证负载
+    // 均衡的分块中，选择冗余计算最少的。同样好的分块中，优先选择更宽的，因为内存中的行是连续的。
+    const Candidate *best = nullptr;
+    for (const Candidate &c : candidates) {
+        if (c.working_set > l1 / 2 || c.tiles < 4 * threads) continue;
+        if (!best || c.overhead < best->overhead ||
+            (c.overhead == best->overhead && c.tile_w > best->tile_w)) {
+            best = &c;
+        }
+    }
+    if (!best) {
+        printf("No tile size fits in L1 with enough parallelism; use compute_root\n");
+        printf("Success!\n");
+        return 0;
+    }
+    printf("\nRecommended tile: %dx%d (%.1f%% redundant, %.0f bytes of producer per tile)\n\n",
+           best->tile_w, best->tile_h, 100 * best->overhead, best->working_set);
+
+    // Check the recommendation against the alternatives by timing.
+    // 通过计时，把推荐的分块与其他选择进行比较。
+    struct Timed {
+        const char *name;
+        int tile_w, tile_h;
+    };
+    Timed timed[] = {
+        {"lesson 8 tiles", 4, 4},
+        {"recommended", best->tile_w, best->tile_h},
+        {"large tiles", 256, 256},
+        {"compute_root", 0, 0},
+    };
+    Buffer<float> reference;
+    for (const Timed &t : timed) {
+        if (t.tile_w > width || t.tile_h > height) continue;
+        Pipeline8 p(t.tile_w, t.tile_h);
+        p.consumer.compile_jit();
+        Buffer<float> out(width, height);
+        double seconds = benchmark(5, 1, [&]() { p.consumer.realize(out); });
+        printf("%-16s %4dx%-4d %8.2f ms\n", t.name, t.tile_w, t.tile_h, seconds * 1e3);
+
+        // All schedules compute the same values.
+        // 所有调度计算的值都相同。
+        if (!reference.defined()) {
+            reference = out;
+        } else if (memcmp(reference.data(), out.data(), out.size_in_bytes()) != 0) {
+            printf("%s gives a different result\n", t.name);
+            return -1;
+        }
+    }
+
+    // The traced and predicted columns agree, which tells us the
+    // formula is right and we can use it to reason about other sizes:
+    // the redundant fraction is about 1/tile_w + 1/tile_h, plus the
+    // shifted edge tiles when the image isn't a multiple of the tile.
+    // The trace needs no formula at all, though, so it keeps working
+    // for pipelines whose footprints aren't as easy to write down.
+    // 跟踪得到的和公式预测的两列一致，说明公式是正确的，可以用它来推断其他尺寸：冗余比例大约是
+    // 1/tile_w + 1/tile_h，图像不是块大小整数倍时再加上向内平移的边缘块。不过跟踪完全不需要公式，
+    // 所以对于作用范围不容易写出来的流水线也同样适用。
+
+    printf("Success!\n");
+    return 0;
+}
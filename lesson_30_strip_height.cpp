@@ -0,0 +1,204 @@
+// Halide tutorial lesson 30: Sliding-window warm-up and choosing the strip height
+// Halide入门教程第三十课：滑动窗口的预热开销与条带高度的选择
+
+// Lesson 8's fastest schedule splits the consumer into strips of 16
+// rows, runs the strips in parallel, and slides the producer down each
+// strip with store_at(consumer, yo).compute_at(consumer, yi). Sliding
+// only works within a strip: each strip starts with an empty window,
+// so its first row computes two producer rows instead of one. That
+// warm-up costs one extra producer row per strip, 1/16 of the work for
+// 16-row strips. Taller strips waste less but give fewer tasks to
+// spread over the threads, and when the strip count isn't a multiple
+// of the thread count, the last round leaves threads idle.
+//
+// This lesson measures both effects for a range of strip heights and
+// thread counts, and picks the strip height from a small cost model
+// fitted to two measurements.
+// 第八课中最快的调度把消费者拆成16行的条带，并行执行各个条带，并用store_at(consumer, yo).compute_at(consumer, yi)
+// 让生产者沿着每个条带向下滑动。滑动只在一个条带内有效：每个条带都从空的窗口开始，所以第一行要计算两行生产者
+// 而不是一行。这个预热开销是每个条带多算一行生产者，对于16行的条带就是1/16的工作量。条带越高浪费越少，但分给
+// 线程的任务越少；而且当条带数不是线程数的整数倍时，最后一轮会有线程空闲。
+//
+// 本课在一系列条带高度和线程数下测量这两种影响，并用一个由两次测量拟合出的简单代价模型选择条带高度。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_30*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_30
+// LD_LIBRARY_PATH=../bin ./lesson_30 [width height]
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "halide_benchmark.h"
+#include "tools/lesson_08_pipeline.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// Producer rows computed, counted from the produce events: the second
+// coordinate pair of each event is the min and extent in y.
+// 计算的生产者行数，由produce事件统计：每个事件的第二对坐标是y方向的最小值和范围。
+static std::atomic<int64_t> producer_rows(0);
+static std::atomic<int> next_id(1);
+
+int count_rows(void *user_context, const halide_trace_event_t *e) {
+    if (e->event == halide_trace_produce && e->dimensions == 4) {
+        producer_rows += e->coordinates[3];
+    }
+    return next_id++;
+}
+
+// Lesson 8's mixed schedule with a given strip height.
+// 第八课的混合调度，使用给定的条带高度。
+struct Pipeline8 : ProducerConsumer {
+    Var yo, yi;
+
+    explicit Pipeline8(int strip) : yo("yo"), yi("yi") {
+        consumer.split(y, yo, yi, strip).parallel(yo).vectorize(x, 4);
+        producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, 4);
+    }
+};
+
+// The cost model. With S = ceil(H / h) strips on T threads, there are
+// ceil(S / T) rounds, and each round takes as long as one strip:
+// h + 1 producer rows plus the fixed cost of starting a task.
+//   time(h) = ceil(S / T) * ((h + 1) * row_cost + task_cost)
+// 代价模型。T个线程上有S = ceil(H / h)个条带，共ceil(S / T)轮，每一轮的时间等于一个条带的时间：
+// h + 1行生产者加上启动一个任务的固定开销。
+static double predicted_time(int height, int h, int threads, double row_cost, double task_cost) {
+    int strips = (height + h - 1) / h;
+    int rounds = (strips + threads - 1) / threads;
+    return rounds * ((h + 1) * row_cost + task_cost);
+}
+
+static int choose_strip_height(int height, int threads, double row_cost, double task_cost,
+                               const std::vector<int> &candidates) {
+    int best = candidates[0];
+    for (int h : candidates) {
+        if (predicted_time(height, h, threads, row_cost, task_cost) <
+            predicted_time(height, best, threads, row_cost, task_cost)) {
+            best = h;
+        }
+    }
+    return best;
+}
+
+// Runs in a child process, so that the Halide thread pool starts with
+// the HL_NUM_THREADS its parent set for it.
+// 在子进程中运行，这样Halide的线程池启动时使用的是父进程为它设置的HL_NUM_THREADS。
+static int run_child(int width, int height, int threads) {
+    std::vector<int> heights;
+    for (int h = 1; h < height; h *= 2) heights.push_back(h);
+    heights.push_back(height);
+
+    Buffer<float> out(width, height);
+    std::vector<double> times;
+    printf("\nHL_NUM_THREADS=%d\n", threads);
+    printf("%8s %8s %12s %12s\n", "strip", "strips", "warm-up", "time");
+    for (int h : heights) {
+        // First count the producer rows, with tracing on...
+        // 先打开跟踪，统计生产者的行数……
+        {
+            Pipeline8 p(h);
+            p.producer.trace_realizations();
+            p.consumer.set_custom_trace(count_rows);
+            producer_rows = 0;
+            p.consumer.realize(out);
+        }
+        double warm_up = (double)producer_rows / (height + 1) - 1;
+
+        // ... then time it with tracing off.
+        // ……然后关闭跟踪计时。
+        Pipeline8 p(h);
+        p.consumer.compile_jit();
+        double t = benchmark(5, 1, [&]() { p.consumer.realize(out); });
+        times.push_back(t);
+        printf("%8d %8d %11.1f%% %9.3f ms\n", h, (height + h - 1) / h, 100 * warm_up, t * 1e3);
+    }
+
+    // Fit the model. One strip covering the whole image is a single
+    // task on a single thread: all of its time is row_cost per row.
+    // One-row strips are mostly task overhead and warm-up.
+    // 拟合模型。覆盖整幅图像的一个条带是一个线程上的一个任务：所有时间都是每行的row_cost。
+    // 一行的条带主要是任务开销和预热。
+    double row_cost = times.back() / (height + 1);
+    int rounds_1 = (height + threads - 1) / threads;
+    double task_cost = std::max(0.0, times[0] / rounds_1 - 2 * row_cost);
+
+    int chosen = choose_strip_height(height, threads, row_cost, task_cost, heights);
+    size_t fastest = std::min_element(times.begin(), times.end()) - times.begin();
+    double chosen_time = times[std::find(heights.begin(), heights.end(), chosen) - heights.begin()];
+    printf("model: %.2f us per producer row, %.2f us per task\n", row_cost * 1e6, task_cost * 1e6);
+    printf("chosen strip height %d (%.3f ms), measured best %d (%.3f ms)\n",
+           chosen, chosen_time * 1e3, heights[fastest], times[fastest] * 1e3);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int width = 3840, height = 2160;
+    if (argc == 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    }
+
+    // The thread counts to try: powers of two up to the core count,
+    // and the core count itself.
+    // 要尝试的线程数：不超过核数的2的幂，以及核数本身。
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<int> thread_counts;
+    for (int t = 1; t < cores; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(cores);
+
+    printf("Consumer %dx%d, producer rows needed: %d\n", width, height, height + 1);
+
+    // Halide reads HL_NUM_THREADS once, when the thread pool starts, so
+    // each thread count gets a fresh process. The parent never runs a
+    // pipeline itself, so it has no threads of its own to worry about
+    // when it forks.
+    // Halide只在线程池启动时读取一次HL_NUM_THREADS，所以每个线程数使用一个新的进程。父进程自己从不运行
+    // 流水线，所以fork时不存在它自己的线程的问题。
+    for (int threads : thread_counts) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            printf("fork failed\n");
+            return -1;
+        }
+        if (pid == 0) {
+            char value[16];
+            snprintf(value, sizeof(value), "%d", threads);
+            setenv("HL_NUM_THREADS", value, 1);
+            int result = run_child(width, height, threads);
+            fflush(stdout);
+            _exit(result == 0 ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("The run with %d threads failed\n", threads);
+            return -1;
+        }
+    }
+
+    // The warm-up column is about 1/h, plus a little extra when h
+    // doesn't divide the height and the last strip is shifted inwards
+    // over its neighbour. On one thread, taller is always better. With
+    // more threads the best height is the tallest one that still gives
+    // every thread the same number of strips, which is why the times
+    // don't fall smoothly with h: they jump wherever the number of
+    // rounds changes. The model captures both, so its choice should be
+    // at or near the measured best.
+    // 预热那一列大约是1/h，当h不能整除高度、最后一个条带向内平移与相邻条带重叠时还会多一点。单线程时条带
+    // 越高越好。线程更多时，最好的高度是仍能让每个线程分到相同数量条带的最高的那个，所以时间并不随h平滑
+    // 下降，而是在轮数变化的地方跳变。模型同时考虑了这两点，所以它的选择应该等于或接近测量到的最优值。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,750 @@
+// Halide tutorial lesson 31: A resident image-processing service with warm pipelines
+// Halide入门教程第三十一课：常驻的图像处理服务，流水线始终保持编译好的状态
+
+// Each earlier lesson is a program that starts, JIT-compiles its
+// pipeline, processes one image and exits. For a large image the
+// compile is lost in the noise, but for a 64x64 thumbnail it is
+// nearly all of the time: compiling takes hundreds of milliseconds,
+// and running the pipeline takes microseconds. This lesson keeps the
+// compiled pipelines in a long-running server instead:
+// - Clients connect over a Unix domain socket and send small job
+//   requests: which pipeline to run, and the names of POSIX shared
+//   memory segments holding the input and output pixels, so that the
+//   pixels themselves are never copied through the socket.
+// - The server compiles the brighten (lesson 2), blur (lesson 7) and
+//   producer/consumer (lesson 8) pipelines once, at start-up.
+// - Jobs go into a bounded queue drained by a fixed set of workers,
+//   and Halide's own thread pool parallelizes inside each job. When
+//   the queue is full the server stops accepting work and tells the
+//   client it is busy, rather than letting the backlog grow without
+//   bound.
+// 前面的每一课都是一个程序：启动，JIT编译流水线，处理一幅图像，然后退出。对于大图，编译的时间可以忽略，但对于
+// 64x64的缩略图，编译几乎就是全部时间：编译需要几百毫秒，而运行流水线只需要几微秒。本课改为在一个长期运行的
+// 服务器中保存编译好的流水线：
+// - 客户端通过Unix域套接字连接，发送很小的任务请求：运行哪个流水线，以及保存输入和输出像素的POSIX共享内存段
+//   的名字，像素本身从不经过套接字复制。
+// - 服务器在启动时一次性编译提亮（第二课）、模糊（第七课）和生产者/消费者（第八课）流水线。
+// - 任务进入一个有界队列，由固定数量的工作线程取出执行，Halide自己的线程池在每个任务内部并行。队列满时，服务器
+//   不再接受新的任务并告诉客户端它很忙，而不是让积压无限增长。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_31*.cpp -g -std=c++11 -I ../include -L ../bin -lHalide -lpthread -ldl -lrt -o lesson_31
+// LD_LIBRARY_PATH=../bin ./lesson_31
+// That runs a demo: a server in a child process, and clients against
+// it. The two halves can also be run separately:
+// LD_LIBRARY_PATH=../bin ./lesson_31 serve /tmp/lesson_31.sock
+// LD_LIBRARY_PATH=../bin ./lesson_31 client /tmp/lesson_31.sock brighten 64 64 100
+// 这会运行一个演示：子进程中的服务器，以及连接它的客户端。两部分也可以分别运行。
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tools/lesson_08_pipeline.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+
+// ---------------------------------------------------------------------
+// The wire protocol
+// 通信协议
+// ---------------------------------------------------------------------
+
+// Fixed-size messages, so reading one is a single read_all(). Client
+// and server are always the same binary on the same machine, so we
+// don't worry about byte order or struct layout.
+// 固定大小的消息，读取一条消息就是一次read_all()。客户端和服务器总是同一台机器上的同一个程序，
+// 所以不需要考虑字节序和结构体布局。
+static const uint32_t kMagic = 0x4c333121;  // "L31!"
+
+enum Op : uint32_t { OpShutdown = 0, OpBrighten = 1, OpBlur = 2, OpProducerConsumer = 3 };
+static const char *op_names[] = {"shutdown", "brighten", "blur", "producer_consumer"};
+
+enum Status : int32_t { StatusOk = 0, StatusBusy = 1, StatusBadRequest = 2, StatusFailed = 3 };
+
+struct JobRequest {
+    uint32_t magic;
+    uint32_t op;
+    // Shared memory names as passed to shm_open, e.g. "/lesson31_in".
+    // The producer/consumer job has no input and leaves in_shm empty.
+    // 传给shm_open的共享内存名字。生产者/消费者任务没有输入，in_shm为空。
+    char in_shm[64];
+    char out_shm[64];
+    int32_t width, height, channels;
+};
+
+struct JobReply {
+    uint32_t magic;
+    int32_t status;
+    double queue_ms, run_ms;
+};
+
+static bool read_all(int fd, void *p, size_t n) {
+    char *c = (char *)p;
+    while (n > 0) {
+        ssize_t r = read(fd, c, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        c += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void *p, size_t n) {
+    const char *c = (const char *)p;
+    while (n > 0) {
+        ssize_t w = send(fd, c, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        c += w;
+        n -= w;
+    }
+    return true;
+}
+
+// Bytes of input and output a request needs.
+// 一个请求所需的输入和输出字节数。
+static size_t input_bytes(const JobRequest &r) {
+    return r.op == OpProducerConsumer ? 0 : (size_t)r.width * r.height * r.channels;
+}
+
+static size_t output_bytes(const JobRequest &r) {
+    if (r.op == OpProducerConsumer) return (size_t)r.width * r.height * sizeof(float);
+    return (size_t)r.width * r.height * r.channels;
+}
+
+// Map a shared memory segment, checking it is at least 'bytes' long.
+// A new segment gets its pages allocated up front: ftruncate would
+// only set the size, and the first write to a page that doesn't fit
+// in /dev/shm would then kill the process with SIGBUS. This way a full
+// /dev/shm makes us return nullptr instead.
+// 映射一个共享内存段，并检查它至少有'bytes'字节。新建的段会预先分配好所有页面：ftruncate只设置大小，
+// 之后向/dev/shm中放不下的页面第一次写入时，进程会被SIGBUS杀掉。这样/dev/shm满了时会返回nullptr。
+static void *map_shm(const char *name, size_t bytes, bool create) {
+    int fd = shm_open(name, create ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (create && posix_fallocate(fd, 0, bytes) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return nullptr;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < bytes) {
+        close(fd);
+        return nullptr;
+    }
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+// ---------------------------------------------------------------------
+// The server
+// 服务器
+// ---------------------------------------------------------------------
+
+// All the pipelines, compiled once. A realize() that binds its input
+// through a ParamMap instead of ImageParam::set() doesn't touch any
+// shared state, so many workers can run the same compiled pipeline at
+// the same time.
+// 所有的流水线，只编译一次。通过ParamMap而不是ImageParam::set()绑定输入的realize()不会修改任何共享的状态，
+// 所以多个工作线程可以同时运行同一个编译好的流水线。
+struct WarmPipelines {
+    ImageParam input;
+    Func brighter, blurred, consumer;
+
+    WarmPipelines() : input(UInt(8), 3, "input") {
+        Var x("x"), y("y"), c("c"), yo("yo"), yi("yi");
+
+        brighter = Func("brighter");
+        brighter(x, y, c) = cast<uint8_t>(min(input(x, y, c) * 1.5f, 255.0f));
+        brighter.reorder(x, y, c).split(y, yo, yi, 32, TailStrategy::GuardWithIf)
+            .parallel(yo).vectorize(x, 16, TailStrategy::GuardWithIf);
+
+        Func clamped = BoundaryConditions::repeat_edge(input);
+        Func input_16("input_16"), blur_x("blur_x"), blur_y("blur_y");
+        blurred = Func("blurred");
+        input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+        blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+        blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+        blurred(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+        blurred.reorder(x, y, c).split(y, yo, yi, 32, TailStrategy::GuardWithIf)
+            .parallel(yo).vectorize(x, 16, TailStrategy::GuardWithIf);
+        blur_x.store_at(blurred, yo).compute_at(blurred, yi).vectorize(x, 16);
+
+        ProducerConsumer lesson_8;
+        consumer = lesson_8.consumer;
+        consumer.split(y, yo, yi, 16, TailStrategy::GuardWithIf)
+            .parallel(yo).vectorize(x, 4, TailStrategy::GuardWithIf);
+        lesson_8.producer.store_at(consumer, yo).compute_at(consumer, yi).vectorize(x, 4);
+
+        // The whole point: pay for compilation here, once.
+        // 关键所在：编译的代价在这里付一次。
+        brighter.compile_jit();
+        blurred.compile_jit();
+        consumer.compile_jit();
+    }
+
+    Status run(const JobRequest &r) {
+        size_t in_size = input_bytes(r), out_size = output_bytes(r);
+        void *in_p = in_size ? map_shm(r.in_shm, in_size, false) : nullptr;
+        void *out_p = map_shm(r.out_shm, out_size, false);
+        Status status = StatusOk;
+        if ((in_size && !in_p) || !out_p) {
+            status = StatusBadRequest;
+        } else if (r.op == OpProducerConsumer) {
+            Buffer<float> out((float *)out_p, r.width, r.height);
+            consumer.realize(out);
+        } else {
+            // Buffers that point straight at the client's shared
+            // memory: planar x, y, c, like everything else in these
+            // lessons.
+            // 直接指向客户端共享内存的buffer：平面排列的x, y, c，与这些课程中的其他buffer一样。
+            Buffer<uint8_t> in((uint8_t *)in_p, r.width, r.height, r.channels);
+            Buffer<uint8_t> out((uint8_t *)out_p, r.width, r.height, r.channels);
+            Buffer<> in_any = in;
+            ParamMap params;
+            params.set(input, in_any);
+            (r.op == OpBrighten ? brighter : blurred).realize(out, get_jit_target_from_environment(), params);
+        }
+        if (in_p) munmap(in_p, in_size);
+        if (out_p) munmap(out_p, out_size);
+        return status;
+    }
+};
+
+// A job waiting in the queue, and the promise its connection thread is
+// waiting on for the reply.
+// 在队列中等待的任务，以及连接线程等待回复所用的promise。
+struct Job {
+    JobRequest request;
+    std::chrono::steady_clock::time_point enqueued;
+    std::promise<JobReply> reply;
+};
+
+// A bounded queue. push() waits up to 'timeout' for room and then gives
+// up; that is the backpressure. pop() returns null once the queue is
+// closed and drained.
+// 有界队列。push()最多等待'timeout'时间以获得空位，然后放弃：这就是背压。pop()在队列关闭并且清空后返回null。
+class JobQueue {
+public:
+    explicit JobQueue(size_t capacity) : capacity(capacity) {}
+
+    bool push(std::shared_ptr<Job> job, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!not_full.wait_for(lock, timeout, [&]() { return closed || jobs.size() < capacity; }) || closed) {
+            return false;
+        }
+        jobs.push_back(job);
+        not_empty.notify_one();
+        return true;
+    }
+
+    std::shared_ptr<Job> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]() { return closed || !jobs.empty(); });
+        if (jobs.empty()) return nullptr;
+        std::shared_ptr<Job> job = jobs.front();
+        jobs.pop_front();
+        not_full.notify_one();
+        return job;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::deque<std::shared_ptr<Job>> jobs;
+    size_t capacity;
+    bool closed = false;
+};
+
+// Server tuning. A couple of workers let a small job start while a big
+// one is running; more than that just makes them fight over Halide's
+// thread pool.
+// 服务器参数。两个工作线程可以在大任务运行时让小任务开始执行；再多的话只会让它们争抢Halide的线程池。
+static const int kWorkers = 2;
+static const size_t kQueueCapacity = 16;
+static const std::chrono::milliseconds kPushTimeout(200);
+static const int kMaxDimension = 16384;
+// Connections beyond this wait in the listen() backlog until one
+// closes, so a flood of clients can't create unbounded threads either.
+// 超过这个数目的连接在listen()的积压队列中等待，直到有连接关闭，所以大量的客户端也不会创建无限多的线程。
+static const size_t kMaxConnections = 64;
+
+static std::atomic<bool> stopping(false);
+
+// The open connections. Each is served by a detached thread, which
+// removes itself when its client goes away, so a long-running server
+// doesn't accumulate finished threads.
+// 打开的连接。每个连接由一个分离的线程服务，客户端离开时线程把自己移除，所以长期运行的服务器不会积累
+// 已经结束的线程。
+class Connections {
+public:
+    // Waits for a free slot. Returns false if the server is stopping.
+    // 等待一个空位。服务器正在停止时返回false。
+    bool wait_for_slot() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return stopping || fds.size() < kMaxConnections; });
+        return !stopping;
+    }
+
+    void add(int fd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fds.insert(fd);
+    }
+
+    // Called by a connection's thread just before it closes the fd.
+    // 由连接的线程在关闭fd之前调用。
+    void remove(int fd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fds.erase(fd);
+        changed.notify_all();
+    }
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+
+    // Stops reading from every open connection, so that idle clients
+    // can't hold up shutdown. A request already in progress still
+    // gets its reply. Then waits for all the threads to finish.
+    // 停止从每个打开的连接读取，这样空闲的客户端不会拖住关闭过程。正在处理的请求仍然会得到回复。然后等待
+    // 所有线程结束。
+    void close_all() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (int fd : fds) shutdown(fd, SHUT_RD);
+        changed.wait(lock, [&]() { return fds.empty(); });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::set<int> fds;
+};
+
+static bool valid(const JobRequest &r) {
+    if (r.magic != kMagic || r.op > OpProducerConsumer) return false;
+    if (r.op == OpShutdown) return true;
+    if (r.width <= 0 || r.height <= 0 || r.width > kMaxDimension || r.height > kMaxDimension) return false;
+    if (r.op != OpProducerConsumer && (r.channels < 1 || r.channels > 4)) return false;
+    return memchr(r.in_shm, 0, sizeof(r.in_shm)) && memchr(r.out_shm, 0, sizeof(r.out_shm));
+}
+
+// One thread per connection. A connection can carry any number of
+// requests, one at a time.
+// 每个连接一个线程。一个连接可以承载任意多个请求，每次一个。
+static void serve_connection(int fd, JobQueue *queue, Connections *connections, int listen_fd) {
+    JobRequest request;
+    while (read_all(fd, &request, sizeof(request))) {
+        JobReply reply = {kMagic, StatusOk, 0, 0};
+        if (!valid(request)) {
+            reply.status = StatusBadRequest;
+        } else if (request.op == OpShutdown) {
+            stopping = true;
+            // Wakes up the main thread, whether it is in accept() or
+            // waiting for a free connection slot.
+            // 唤醒主线程，无论它是在accept()中，还是在等待空闲的连接位置。
+            shutdown(listen_fd, SHUT_RDWR);
+            connections->wake();
+        } else {
+            auto job = std::make_shared<Job>();
+            job->request = request;
+            job->enqueued = std::chrono::steady_clock::now();
+            std::future<JobReply> result = job->reply.get_future();
+            if (!queue->push(job, kPushTimeout)) {
+                reply.status = StatusBusy;
+            } else {
+                reply = result.get();
+            }
+        }
+        if (!write_all(fd, &reply, sizeof(reply))) break;
+    }
+    connections->remove(fd);
+    close(fd);
+}
+
+static void worker(JobQueue *queue, WarmPipelines *pipelines) {
+    while (std::shared_ptr<Job> job = queue->pop()) {
+        auto start = std::chrono::steady_clock::now();
+        JobReply reply = {kMagic, StatusOk, 0, 0};
+        reply.queue_ms = std::chrono::duration<double, std::milli>(start - job->enqueued).count();
+        try {
+            reply.status = pipelines->run(job->request);
+        } catch (...) {
+            reply.status = StatusFailed;
+        }
+        reply.run_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        job->reply.set_value(reply);
+    }
+}
+
+static int run_server(const std::string &socket_path) {
+    auto t0 = std::chrono::steady_clock::now();
+    WarmPipelines pipelines;
+    double compile_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socket_path.c_str());
+    // Only this user may connect.
+    // 只有当前用户可以连接。
+    mode_t old_mask = umask(077);
+    bool bound = bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listen_fd, 64) != 0) {
+        printf("server: can't listen on %s: %s\n", socket_path.c_str(), strerror(errno));
+        return -1;
+    }
+    printf("server: pipelines compiled in %.0f ms, listening on %s\n", compile_ms, socket_path.c_str());
+    fflush(stdout);
+
+    JobQueue queue(kQueueCapacity);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < kWorkers; i++) workers.emplace_back(worker, &queue, &pipelines);
+
+    Connections connections;
+    while (connections.wait_for_slot()) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        connections.add(fd);
+        std::thread(serve_connection, fd, &queue, &connections, listen_fd).detach();
+    }
+
+    // Finish the jobs already queued, then stop.
+    // 完成已经在队列中的任务，然后停止。
+    connections.close_all();
+    queue.close();
+    for (std::thread &t : workers) t.join();
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    printf("server: stopped\n");
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// The client
+// 客户端
+// ---------------------------------------------------------------------
+
+static int connect_to(const std::string &socket_path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// A client's view of one job: its shared memory, created and filled by
+// the client, and unlinked when the client is done with it.
+// 客户端眼中的一个任务：由客户端创建并填充的共享内存，客户端用完后删除。
+struct ClientJob {
+    JobRequest request;
+    uint8_t *in = nullptr;
+    void *out = nullptr;
+
+    ClientJob(Op op, int width, int height, int channels, int id) {
+        memset(&request, 0, sizeof(request));
+        request.magic = kMagic;
+        request.op = op;
+        request.width = width;
+        request.height = height;
+        request.channels = op == OpProducerConsumer ? 1 : channels;
+        if (op != OpProducerConsumer) {
+            snprintf(request.in_shm, sizeof(request.in_shm), "/lesson31_%d_%d_in", (int)getpid(), id);
+            in = (uint8_t *)map_shm(request.in_shm, input_bytes(request), true);
+            if (in) {
+                Buffer<uint8_t> image(in, width, height, channels);
+                fill_synthetic(image);
+            }
+        }
+        snprintf(request.out_shm, sizeof(request.out_shm), "/lesson31_%d_%d_out", (int)getpid(), id);
+        out = map_shm(request.out_shm, output_bytes(request), true);
+    }
+
+    bool ok() const { return out && (in || request.op == OpProducerConsumer); }
+
+    // The brighten result is easy to check on the client side.
+    // 提亮的结果在客户端很容易检查。
+    bool check_brighten() const {
+        const uint8_t *o = (const uint8_t *)out;
+        for (size_t i = 0; i < input_bytes(request); i++) {
+            uint8_t expected = (uint8_t)std::min(in[i] * 1.5f, 255.0f);
+            if (o[i] != expected) return false;
+        }
+        return true;
+    }
+
+    ~ClientJob() {
+        if (in) {
+            munmap(in, input_bytes(request));
+            shm_unlink(request.in_shm);
+        }
+        if (out) {
+            munmap(out, output_bytes(request));
+            shm_unlink(request.out_shm);
+        }
+    }
+};
+
+// Shared memory names must be unique to each client in this process:
+// the first client to finish unlinks its names, which would pull the
+// segments out from under any other client using the same ones.
+// 共享内存的名字在本进程的每个客户端之间必须唯一：第一个完成的客户端会删除它的名字，如果其他客户端使用
+// 相同的名字，它们的共享内存段就会在使用中被删掉。
+static std::atomic<int> next_client_id(0);
+
+// Send 'count' requests for the same job down one connection and
+// report the round-trip latency. Returns false on any error.
+// 在一个连接上为同一个任务发送'count'个请求，并报告往返延迟。出现任何错误时返回false。
+static bool run_client(const std::string &socket_path, Op op, int width, int height, int count) {
+    int fd = connect_to(socket_path);
+    if (fd < 0) {
+        printf("client: can't connect to %s\n", socket_path.c_str());
+        return false;
+    }
+    ClientJob job(op, width, height, 3, next_client_id++);
+    if (!job.ok()) {
+        printf("client: can't create shared memory\n");
+        close(fd);
+        return false;
+    }
+
+    std::vector<double> latencies;
+    double queue_ms = 0, run_ms = 0;
+    int busy = 0;
+    for (int i = 0; i < count; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        JobReply reply;
+        if (!write_all(fd, &job.request, sizeof(job.request)) || !read_all(fd, &reply, sizeof(reply)) ||
+            reply.magic != kMagic) {
+            printf("client: lost the connection\n");
+            close(fd);
+            return false;
+        }
+        if (reply.status == StatusBusy) {
+            busy++;
+            continue;
+        }
+        if (reply.status != StatusOk) {
+            printf("client: job failed with status %d\n", reply.status);
+            close(fd);
+            return false;
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+        queue_ms += reply.queue_ms;
+        run_ms += reply.run_ms;
+    }
+    close(fd);
+
+    if (op == OpBrighten && !latencies.empty() && !job.check_brighten()) {
+        printf("client: brighten result is wrong\n");
+        return false;
+    }
+    if (latencies.empty()) {
+        printf("%-18s %5dx%-5d all %d requests were refused as busy\n", op_names[op], width, height, busy);
+        return true;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    int n = (int)latencies.size();
+    printf("%-18s %5dx%-5d round trip median %8.3f ms  p99 %8.3f ms  (queued %.3f, ran %.3f ms avg)%s\n",
+           op_names[op], width, height, latencies[n / 2], latencies[std::min(n - 1, n * 99 / 100)],
+           queue_ms / n, run_ms / n, busy ? "  some busy" : "");
+    return true;
+}
+
+static bool send_shutdown(const std::string &socket_path) {
+    int fd = connect_to(socket_path);
+    if (fd < 0) return false;
+    JobRequest request;
+    memset(&request, 0, sizeof(request));
+    request.magic = kMagic;
+    request.op = OpShutdown;
+    JobReply reply;
+    bool ok = write_all(fd, &request, sizeof(request)) && read_all(fd, &reply, sizeof(reply));
+    close(fd);
+    return ok;
+}
+
+static int parse_op(const char *name) {
+    for (int i = 1; i <= OpProducerConsumer; i++) {
+        if (!strcmp(name, op_names[i])) return i;
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------------
+// The demo
+// 演示
+// ---------------------------------------------------------------------
+
+static int run_demo() {
+    std::string socket_path = "/tmp/lesson_31_" + std::to_string((int)getpid()) + ".sock";
+
+    // The server runs in a child process, just as it would run as a
+    // separate daemon. The parent hasn't touched Halide yet, so there
+    // are no threads to worry about across the fork.
+    // 服务器运行在子进程中，就像作为独立的守护进程运行一样。父进程还没有使用过Halide，所以fork时不存在线程的问题。
+    fflush(stdout);
+    pid_t server = fork();
+    if (server < 0) return -1;
+    if (server == 0) {
+        _exit(run_server(socket_path) == 0 ? 0 : 1);
+    }
+
+    // Wait for the server to finish compiling and start listening.
+    // 等待服务器完成编译并开始监听。
+    int fd = -1;
+    for (int i = 0; i < 600 && fd < 0; i++) {
+        fd = connect_to(socket_path);
+        if (fd < 0) usleep(100 * 1000);
+    }
+    if (fd < 0) {
+        printf("The server never came up\n");
+        kill(server, SIGTERM);
+        return -1;
+    }
+    close(fd);
+
+    // Sequential requests from one client: the latency of a warm
+    // pipeline at thumbnail and full HD sizes.
+    // 一个客户端的顺序请求：缩略图和全高清尺寸下热流水线的延迟。
+    struct Case {
+        Op op;
+        int width, height, count;
+    };
+    Case cases[] = {
+        {OpBrighten, 64, 64, 200},
+        {OpBlur, 64, 64, 200},
+        {OpProducerConsumer, 64, 64, 200},
+        {OpBrighten, 1920, 1080, 20},
+        {OpBlur, 1920, 1080, 20},
+        {OpProducerConsumer, 1920, 1080, 20},
+    };
+    bool ok = true;
+    for (const Case &k : cases) {
+        ok = run_client(socket_path, k.op, k.width, k.height, k.count) && ok;
+    }
+
+    // A burst from many clients at once, with full HD images, to fill
+    // the queue: some requests wait, and once the queue is full, some
+    // are turned away as busy instead of piling up. Each client holds
+    // an input and an output frame in shared memory, about 400 MB for
+    // the whole burst; a smaller /dev/shm (Docker's default is 64 MB)
+    // makes the clients report that they can't create shared memory.
+    // 多个客户端同时突发全高清图像请求，填满队列：一些请求需要等待，队列满后一些请求会被以繁忙为由拒绝，而不是
+    // 堆积起来。每个客户端在共享内存中持有一帧输入和一帧输出，整个突发大约需要400MB；/dev/shm更小时（Docker
+    // 默认是64MB），客户端会报告无法创建共享内存。
+    printf("\nBurst of 32 concurrent clients:\n");
+    std::vector<std::thread> clients;
+    std::atomic<bool> burst_ok(true);
+    for (int i = 0; i < 32; i++) {
+        clients.emplace_back([&]() {
+            if (!run_client(socket_path, OpBlur, 1920, 1080, 3)) burst_ok = false;
+        });
+    }
+    for (std::thread &t : clients) t.join();
+    ok = ok && burst_ok;
+
+    send_shutdown(socket_path);
+    int status = 0;
+    waitpid(server, &status, 0);
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("The demo failed\n");
+        return -1;
+    }
+
+    // For comparison, what every job would pay without the server: a
+    // fresh process compiling the brighten pipeline before it can
+    // process its first image. (Process start-up and loading
+    // libHalide come on top of this.)
+    // 作为对比，没有服务器时每个任务都要付出的代价：一个新的进程在处理第一幅图像之前要先编译提亮流水线
+    // （进程启动和加载libHalide的时间还要另算）。
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        Var x, y, c;
+        Buffer<uint8_t> input(64, 64, 3);
+        input.fill(100);
+        Func brighter;
+        brighter(x, y, c) = cast<uint8_t>(min(input(x, y, c) * 1.5f, 255.0f));
+        brighter.vectorize(x, 16, TailStrategy::GuardWithIf).parallel(y);
+        brighter.realize(64, 64, 3);
+    }
+    printf("\nOne-shot brighten of 64x64, including JIT compile: %.1f ms\n",
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+
+    // The warm 64x64 round trips come in well under a millisecond,
+    // most of it the socket and the mapping of the shared memory,
+    // against hundreds of milliseconds for the one-shot program. For
+    // full HD frames the pipeline dominates either way. Under the
+    // burst, the queue keeps latency bounded: a client is either
+    // served after at most a queue's worth of jobs, or told quickly to
+    // come back later.
+    // 热流水线的64x64往返时间远小于一毫秒，其中大部分是套接字和映射共享内存的时间，而一次性的程序需要几百毫秒。
+    // 对于全高清图像，两种方式的时间都主要花在流水线上。在突发负载下，队列使延迟有上限：客户端要么在最多
+    // 一个队列长度的任务之后得到服务，要么很快被告知稍后再来。
+
+    printf("Success!\n");
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && !strcmp(argv[1], "serve")) {
+        return run_server(argv[2]);
+    }
+    if (argc >= 6 && !strcmp(argv[1], "client")) {
+        int op = parse_op(argv[3]);
+        if (op < 0) {
+            printf("Unknown job '%s': use brighten, blur or producer_consumer\n", argv[3]);
+            return -1;
+        }
+        int count = argc >= 7 ? atoi(argv[6]) : 1;
+        return run_client(argv[2], (Op)op, atoi(argv[4]), atoi(argv[5]), count) ? 0 : -1;
+    }
+    if (argc >= 3 && !strcmp(argv[1], "stop")) {
+        return send_shutdown(argv[2]) ? 0 : -1;
+    }
+    return run_demo();
+}
@@ -0,0 +1,775 @@
+// Halide tutorial lesson 32: Loading schedules from configuration files
+// Halide入门教程第三十二课：从配置文件加载调度
+
+// In lessons 5, 7 and 8 the schedules are C++ code, so trying a
+// different split factor means editing and recompiling the program.
+// But an algorithm and its schedule are separate, and nothing about a
+// schedule needs to be known when the program is built: the directives
+// are just method calls on Funcs, made before the pipeline is
+// JIT-compiled. This lesson reads them from a small text file instead:
+//
+//   pipeline lesson_08
+//   consumer split y yo yi 16
+//   consumer parallel yo
+//   producer compute_at consumer yi
+//
+// Each line names a Func, a directive (split, tile, reorder, vectorize,
+// parallel, compute_at, compute_root, store_at or store_root) and its
+// arguments. The whole file is checked against the pipeline before any
+// of it is applied, and a mistake is reported with its line number,
+// rather than as a Halide error at compile time, or not at all.
+// 在第五、七、八课中，调度是C++代码，所以尝试一个不同的拆分因子就意味着修改并重新编译程序。但算法和调度是
+// 分开的，调度的任何内容都不需要在构建程序时就知道：调度指令只是在JIT编译流水线之前对Func的方法调用。本课
+// 改为从一个小的文本文件中读取它们。每一行给出一个Func、一条指令（split、tile、reorder、vectorize、parallel、
+// compute_at、compute_root、store_at或store_root）以及它的参数。整个文件在应用之前先对照流水线进行检查，
+// 错误会带着行号报告出来，而不是在编译时成为Halide的错误，或者根本不报错。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_32*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_32
+// LD_LIBRARY_PATH=../bin ./lesson_32 [schedule files...]
+// With no arguments it runs the samples in the schedules directory.
+// 不带参数时运行schedules目录中的示例。
+
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "halide_benchmark.h"
+#include "tools/lesson_08_pipeline.h"
+#include "tools/synthetic_image.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+// ---------------------------------------------------------------------
+// The pipelines a schedule file can refer to
+// 调度文件可以引用的流水线
+// ---------------------------------------------------------------------
+
+// The algorithm of each pipeline, without any schedule. Every Func and
+// Var is named, because the schedule file refers to them by name.
+// 'consumers' lists which Funcs call each Func, which is what decides
+// where it may be computed.
+// 每个流水线的算法，不含任何调度。每个Func和Var都有名字，因为调度文件按名字引用它们。'consumers'列出每个
+// Func被哪些Func调用，这决定了它可以在哪里计算。
+struct PipelineDef {
+    std::string name;
+    Func output;
+    std::map<std::string, Func> funcs;
+    std::map<std::string, std::vector<std::string>> consumers;
+    int width, height, channels;
+};
+
+static PipelineDef make_lesson_05() {
+    PipelineDef p;
+    Var x("x"), y("y");
+    Func gradient_fast("gradient_fast");
+    gradient_fast(x, y) = x + y;
+    p.name = "lesson_05";
+    p.output = gradient_fast;
+    p.funcs["gradient_fast"] = gradient_fast;
+    p.width = 3840;
+    p.height = 2160;
+    p.channels = 0;
+    return p;
+}
+
+static PipelineDef make_lesson_07(Buffer<uint8_t> input) {
+    PipelineDef p;
+    Var x("x"), y("y"), c("c");
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func input_16("input_16"), blur_x("blur_x"), blur_y("blur_y"), blur("blur");
+    input_16(x, y, c) = cast<uint16_t>(clamped(x, y, c));
+    blur_x(x, y, c) = (input_16(x-1, y, c) + 2 * input_16(x, y, c) + input_16(x+1, y, c)) / 4;
+    blur_y(x, y, c) = (blur_x(x, y-1, c) + 2 * blur_x(x, y, c) + blur_x(x, y+1, c)) / 4;
+    blur(x, y, c) = cast<uint8_t>(blur_y(x, y, c));
+    p.name = "lesson_07";
+    p.output = blur;
+    p.funcs["input_16"] = input_16;
+    p.funcs["blur_x"] = blur_x;
+    p.funcs["blur_y"] = blur_y;
+    p.funcs["blur"] = blur;
+    p.consumers["input_16"] = {"blur_x"};
+    p.consumers["blur_x"] = {"blur_y"};
+    p.consumers["blur_y"] = {"blur"};
+    p.width = input.width();
+    p.height = input.height();
+    p.channels = input.channels();
+    return p;
+}
+
+static PipelineDef make_lesson_08() {
+    PipelineDef p;
+    ProducerConsumer lesson_8;
+    p.name = "lesson_08";
+    p.output = lesson_8.consumer;
+    p.funcs["producer"] = lesson_8.producer;
+    p.funcs["consumer"] = lesson_8.consumer;
+    p.consumers["producer"] = {"consumer"};
+    p.width = 3840;
+    p.height = 2160;
+    p.channels = 0;
+    return p;
+}
+
+// ---------------------------------------------------------------------
+// Parsing
+// 解析
+// ---------------------------------------------------------------------
+
+struct Directive {
+    int line;
+    std::string func, op;
+    std::vector<std::string> args;
+};
+
+struct ScheduleConfig {
+    std::string file, pipeline;
+    std::vector<Directive> directives;
+};
+
+// Splits the text into lines of whitespace-separated words. '#' starts
+// a comment. The first non-empty line must name the pipeline.
+// 把文本拆成由空白分隔的单词组成的行。'#'开始一个注释。第一个非空行必须给出流水线的名字。
+static bool parse_schedule(const std::string &file, const std::string &text,
+                           ScheduleConfig *config, std::string *error) {
+    config->file = file;
+    std::istringstream lines(text);
+    std::string line;
+    for (int n = 1; std::getline(lines, line); n++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::vector<std::string> w;
+        std::string word;
+        while (words >> word) w.push_back(word);
+        if (w.empty()) continue;
+
+        if (config->pipeline.empty()) {
+            if (w.size() != 2 || w[0] != "pipeline") {
+                *error = file + ":" + std::to_string(n) + ": expected 'pipeline <name>' first";
+                return false;
+            }
+            config->pipeline = w[1];
+            continue;
+        }
+        if (w.size() < 2) {
+            *error = file + ":" + std::to_string(n) + ": expected '<func> <directive> <args...>'";
+            return false;
+        }
+        Directive d;
+        d.line = n;
+        d.func = w[0];
+        d.op = w[1];
+        d.args.assign(w.begin() + 2, w.end());
+        config->directives.push_back(d);
+    }
+    if (config->pipeline.empty()) {
+        *error = file + ": empty schedule";
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------
+// Validation
+// 验证
+// ---------------------------------------------------------------------
+
+// We check a schedule by replaying it on a model of each Func's loop
+// nest: the list of its loop variables, innermost first, as Halide
+// keeps it. That's enough to catch the mistakes Halide would otherwise
+// report late and far from the file: a Var that doesn't exist (or no
+// longer does, because it was split), a compute_at a loop of a Func
+// that doesn't use this one or with a Func in between that runs
+// outside that loop, or storage placed inside the compute level.
+// 我们在每个Func循环嵌套的模型上重放调度来检查它：模型就是Func的循环变量列表，最内层在前，与Halide内部的
+// 表示相同。这足以发现Halide会很晚才报告、而且离文件很远的错误：不存在（或者因为被拆分而不再存在）的Var，
+// 在不使用本Func的Func的循环上compute_at、或者中间有Func在那个循环之外运行，或者存储位置在计算位置的内部。
+struct LoopNest {
+    std::vector<std::string> dims;        // innermost first
+    std::map<std::string, int> extents;   // known constant extents
+    std::set<std::string> vectorized, parallel;
+    std::string compute_func, compute_var, store_func, store_var;
+    bool compute_root = false, store_root = false;
+    int compute_line = 0, store_line = 0;
+};
+
+class ScheduleChecker {
+public:
+    ScheduleChecker(const PipelineDef &p, const ScheduleConfig &config)
+        : p(p), config(config) {
+        for (const auto &f : p.funcs) {
+            LoopNest &nest = nests[f.first];
+            for (const Var &v : f.second.args()) {
+                nest.dims.push_back(v.name());
+            }
+        }
+    }
+
+    bool check(std::string *error) {
+        if (config.pipeline != p.name) {
+            return fail(0, "schedule is for pipeline '" + config.pipeline + "', not '" + p.name + "'", error);
+        }
+        for (const Directive &d : config.directives) {
+            if (!check_directive(d, error)) return false;
+        }
+        // Where a Func is computed can only be checked once the loop
+        // nests it refers to are final.
+        // Func在哪里计算，只有在它引用的循环嵌套确定之后才能检查。
+        for (const auto &n : nests) {
+            if (!check_placement(n.first, n.second, error)) return false;
+        }
+        return true;
+    }
+
+private:
+    const PipelineDef &p;
+    const ScheduleConfig &config;
+    std::map<std::string, LoopNest> nests;
+
+    bool fail(int line, const std::string &message, std::string *error) {
+        *error = config.file + (line ? ":" + std::to_string(line) : std::string()) + ": " + message;
+        return false;
+    }
+
+    static bool has(const LoopNest &nest, const std::string &v) {
+        return std::find(nest.dims.begin(), nest.dims.end(), v) != nest.dims.end();
+    }
+
+    static bool parse_positive(const std::string &s, int *value) {
+        char *end = nullptr;
+        long v = strtol(s.c_str(), &end, 10);
+        if (s.empty() || *end || v <= 0 || v > 65536) return false;
+        *value = (int)v;
+        return true;
+    }
+
+    // Replaces v with inner and outer, in place, the way split does.
+    // 像split那样，原地把v替换为inner和outer。
+    static void split_dim(LoopNest &nest, const std::string &v, const std::string &outer,
+                          const std::string &inner, int factor) {
+        auto it = std::find(nest.dims.begin(), nest.dims.end(), v);
+        *it = outer;
+        nest.dims.insert(it, inner);
+        nest.extents.erase(v);
+        nest.extents[inner] = factor;
+    }
+
+    // The arguments are args[first], args[first + 1], ... and an
+    // optional tail strategy after 'count' of them.
+    // 参数为args[first], args[first + 1], ...，以及'count'个参数之后可选的尾部策略。
+    bool check_arity(const Directive &d, size_t count, bool tail_allowed, std::string *error) {
+        if (d.args.size() == count) return true;
+        if (tail_allowed && d.args.size() == count + 1) {
+            const std::string &t = d.args.back();
+            if (t == "round_up" || t == "guard_with_if" || t == "shift_inwards") return true;
+            return fail(d.line, "unknown tail strategy '" + t + "'", error);
+        }
+        return fail(d.line, d.op + " takes " + std::to_string(count) + " arguments", error);
+    }
+
+    bool check_new_name(const Directive &d, const LoopNest &nest, const std::string &name,
+                        const std::string &replaced, std::string *error) {
+        if (name != replaced && has(nest, name)) {
+            return fail(d.line, "'" + name + "' is already a loop of " + d.func, error);
+        }
+        return true;
+    }
+
+    bool check_existing(const Directive &d, const LoopNest &nest, const std::string &v, std::string *error) {
+        if (!has(nest, v)) {
+            return fail(d.line, d.func + " has no loop '" + v + "'", error);
+        }
+        return true;
+    }
+
+    bool check_directive(const Directive &d, std::string *error) {
+        auto found = nests.find(d.func);
+        if (found == nests.end()) {
+            return fail(d.line, "pipeline " + p.name + " has no Func '" + d.func + "'", error);
+        }
+        LoopNest &nest = found->second;
+        const std::vector<std::string> &a = d.args;
+
+        if (d.op == "split") {
+            int factor;
+            if (!check_arity(d, 4, true, error) ||
+                !check_existing(d, nest, a[0], error) ||
+                !check_new_name(d, nest, a[1], a[0], error) ||
+                !check_new_name(d, nest, a[2], "", error)) return false;
+            if (a[1] == a[2]) return fail(d.line, "split needs two different names", error);
+            if (!parse_positive(a[3], &factor)) return fail(d.line, "bad split factor '" + a[3] + "'", error);
+            split_dim(nest, a[0], a[1], a[2], factor);
+        } else if (d.op == "tile") {
+            int fx, fy;
+            if (!check_arity(d, 8, true, error) ||
+                !check_existing(d, nest, a[0], error) ||
+                !check_existing(d, nest, a[1], error)) return false;
+            if (a[0] == a[1]) return fail(d.line, "tile needs two different loops", error);
+            std::set<std::string> names(a.begin() + 2, a.begin() + 6);
+            if (names.size() != 4) return fail(d.line, "tile needs four different names", error);
+            for (int i = 2; i < 6; i++) {
+                if (!check_new_name(d, nest, a[i], a[i % 2 == 0 ? 0 : 1], error)) return false;
+            }
+            if (!parse_positive(a[6], &fx) || !parse_positive(a[7], &fy)) {
+                return fail(d.line, "bad tile size", error);
+            }
+            // tile(x, y, xo, yo, xi, yi) is two splits and a reorder
+            // to xi, yi, xo, yo.
+            // tile(x, y, xo, yo, xi, yi)就是两次拆分加上一次重排，顺序为xi, yi, xo, yo。
+            split_dim(nest, a[0], a[2], a[4], fx);
+            split_dim(nest, a[1], a[3], a[5], fy);
+            reorder(nest, {a[4], a[5], a[2], a[3]});
+        } else if (d.op == "reorder") {
+            if (a.size() < 2) return fail(d.line, "reorder takes at least two loops", error);
+            std::set<std::string> names(a.begin(), a.end());
+            if (names.size() != a.size()) return fail(d.line, "reorder names a loop twice", error);
+            for (const std::string &v : a) {
+                if (!check_existing(d, nest, v, error)) return false;
+            }
+            reorder(nest, a);
+        } else if (d.op == "vectorize") {
+            int factor = 0;
+            if (a.size() != 1 && !check_arity(d, 2, true, error)) return false;
+            if (!check_existing(d, nest, a[0], error)) return false;
+            if (nest.vectorized.count(a[0]) || nest.parallel.count(a[0])) {
+                return fail(d.line, "'" + a[0] + "' is already vectorized or parallel", error);
+            }
+            if (a.size() == 1) {
+                // Without a factor, the loop itself becomes the vector,
+                // so its extent must be a known constant.
+                // 不给出因子时，循环本身就成为向量，所以它的范围必须是已知的常数。
+                if (!nest.extents.count(a[0])) {
+                    return fail(d.line, "'" + a[0] + "' has no constant extent; give a vector width", error);
+                }
+                nest.vectorized.insert(a[0]);
+            } else {
+                if (!parse_positive(a[1], &factor)) return fail(d.line, "bad vector width '" + a[1] + "'", error);
+                std::string inner = a[0] + ".v";
+                split_dim(nest, a[0], a[0], inner, factor);
+                nest.vectorized.insert(inner);
+            }
+        } else if (d.op == "parallel") {
+            if (!check_arity(d, 1, false, error) || !check_existing(d, nest, a[0], error)) return false;
+            if (nest.vectorized.count(a[0])) return fail(d.line, "'" + a[0] + "' is already vectorized", error);
+            nest.parallel.insert(a[0]);
+        } else if (d.op == "compute_at" || d.op == "store_at") {
+            if (!check_arity(d, 2, false, error)) return false;
+            bool compute = d.op == "compute_at";
+            (compute ? nest.compute_func : nest.store_func) = a[0];
+            (compute ? nest.compute_var : nest.store_var) = a[1];
+            (compute ? nest.compute_line : nest.store_line) = d.line;
+        } else if (d.op == "compute_root" || d.op == "store_root") {
+            if (!check_arity(d, 0, false, error)) return false;
+            bool compute = d.op == "compute_root";
+            (compute ? nest.compute_root : nest.store_root) = true;
+            (compute ? nest.compute_line : nest.store_line) = d.line;
+        } else {
+            return fail(d.line, "unknown directive '" + d.op + "'", error);
+        }
+        return true;
+    }
+
+    // reorder(a, b, c) puts a, b and c, innermost first, in the slots
+    // they already occupy, leaving every other loop where it is.
+    // reorder(a, b, c)把a、b、c按从内到外的顺序放进它们已经占据的位置，其他循环保持不动。
+    static void reorder(LoopNest &nest, const std::vector<std::string> &order) {
+        std::vector<size_t> slots;
+        for (size_t i = 0; i < nest.dims.size(); i++) {
+            if (std::find(order.begin(), order.end(), nest.dims[i]) != order.end()) slots.push_back(i);
+        }
+        for (size_t i = 0; i < slots.size(); i++) {
+            nest.dims[slots[i]] = order[i];
+        }
+    }
+
+    // True if 'consumer' uses 'func', directly or through other Funcs.
+    // 如果'consumer'直接或者通过其他Func使用了'func'，返回true。
+    bool uses(const std::string &consumer, const std::string &func) const {
+        auto it = p.consumers.find(func);
+        if (it == p.consumers.end()) return false;
+        for (const std::string &c : it->second) {
+            if (c == consumer || uses(consumer, c)) return true;
+        }
+        return false;
+    }
+
+    std::vector<std::string> consumers_of(const std::string &func) const {
+        auto it = p.consumers.find(func);
+        return it == p.consumers.end() ? std::vector<std::string>() : it->second;
+    }
+
+    static long position(const LoopNest &nest, const std::string &v) {
+        return std::find(nest.dims.begin(), nest.dims.end(), v) - nest.dims.begin();
+    }
+
+    // True if Func 'c' runs entirely inside loop 'var' of 'func': it is
+    // computed at that loop or one inside it, or at a Func that is
+    // itself inside, or it is inlined into consumers that all are.
+    // 如果Func 'c'完全在'func'的循环'var'内部运行，返回true：它计算在那个循环或者更内层的循环中，或者计算在
+    // 一个本身就在内部的Func中，或者它被内联到的所有消费者都在内部。
+    bool inside(const std::string &c, const std::string &func, const std::string &var) const {
+        const LoopNest &n = nests.at(c);
+        if (n.compute_root) return false;
+        if (n.compute_func.empty()) {
+            if (c == p.output.name()) return false;
+            for (const std::string &next : consumers_of(c)) {
+                if (next != func && !inside(next, func, var)) return false;
+            }
+            return true;
+        }
+        if (n.compute_func == func) {
+            return position(nests.at(func), n.compute_var) <= position(nests.at(func), var);
+        }
+        return inside(n.compute_func, func, var);
+    }
+
+    bool check_placement(const std::string &name, const LoopNest &nest, std::string *error) {
+        bool is_output = name == p.output.name();
+        bool computed = nest.compute_root || !nest.compute_func.empty();
+        bool stored = nest.store_root || !nest.store_func.empty();
+        int line = std::max(nest.compute_line, nest.store_line);
+        if (is_output && (computed || stored)) {
+            return fail(line, name + " is the output; it is always computed at the root", error);
+        }
+        if (nest.compute_root && !nest.compute_func.empty()) {
+            return fail(line, name + " has both compute_root and compute_at", error);
+        }
+        if (nest.store_root && !nest.store_func.empty()) {
+            return fail(line, name + " has both store_root and store_at", error);
+        }
+        if (stored && !computed) {
+            return fail(line, name + " has a storage level but is computed inline", error);
+        }
+        if (!nest.compute_func.empty()) {
+            if (!check_level(name, nest.compute_func, nest.compute_var, nest.compute_line, error)) return false;
+            // Every Func between this one and the Func whose loop it is
+            // computed at has to run inside that loop too, or its uses
+            // would come before the values exist.
+            // 在本Func和它计算所在循环的Func之间的每个Func也必须在那个循环内部运行，否则它们使用这些值时，
+            // 这些值还不存在。
+            for (const std::string &c : consumers_of(name)) {
+                if (c != nest.compute_func && !inside(c, nest.compute_func, nest.compute_var)) {
+                    return fail(nest.compute_line, name + " is computed at " + nest.compute_func + "." +
+                                nest.compute_var + ", but " + c + " uses it outside that loop", error);
+                }
+            }
+        }
+        if (!nest.store_func.empty()) {
+            if (!check_level(name, nest.store_func, nest.store_var, nest.store_line, error)) return false;
+            // Storage must be at or outside the compute level, so in
+            // the same Func, at the same loop or one further out.
+            // 存储必须在计算位置上或者在它的外面，即在同一个Func中，位于同一个循环或者更外层的循环。
+            if (nest.compute_root) {
+                return fail(nest.store_line, name + " is stored inside its compute_root level", error);
+            }
+            const LoopNest &at = nests.at(nest.compute_func);
+            if (nest.store_func != nest.compute_func) {
+                return fail(nest.store_line, name + " is stored in " + nest.store_func +
+                            " but computed in " + nest.compute_func, error);
+            }
+            if (position(at, nest.store_var) < position(at, nest.compute_var)) {
+                return fail(nest.store_line, name + " is stored at " + nest.store_var +
+                            ", inside its compute level " + nest.compute_var, error);
+            }
+        }
+        return true;
+    }
+
+    bool check_level(const std::string &name, const std::string &func, const std::string &var,
+                     int line, std::string *error) {
+        auto at = nests.find(func);
+        if (at == nests.end()) {
+            return fail(line, "pipeline " + p.name + " has no Func '" + func + "'", error);
+        }
+        if (!uses(func, name)) {
+            return fail(line, func + " doesn't use " + name, error);
+        }
+        // A loop of an inlined Func doesn't exist to be computed at.
+        // 内联的Func没有循环可以在其中计算。
+        const LoopNest &f = at->second;
+        if (func != p.output.name() && !f.compute_root && f.compute_func.empty()) {
+            return fail(line, func + " is computed inline, so it has no loops to compute " + name + " at", error);
+        }
+        if (!has(f, var) || var.find('.') != std::string::npos) {
+            return fail(line, func + " has no loop '" + var + "'", error);
+        }
+        if (f.vectorized.count(var)) {
+            return fail(line, "can't compute " + name + " inside vectorized loop " + var, error);
+        }
+        return true;
+    }
+};
+
+// ---------------------------------------------------------------------
+// Applying a checked schedule
+// 应用检查过的调度
+// ---------------------------------------------------------------------
+
+// Vars are matched by name, so a Var made here from a name in the file
+// refers to the same loop as the one in the algorithm.
+// Var按名字匹配，所以这里用文件中的名字创建的Var与算法中的Var引用的是同一个循环。
+static TailStrategy tail_of(const Directive &d, size_t count) {
+    if (d.args.size() <= count) return TailStrategy::Auto;
+    const std::string &t = d.args.back();
+    if (t == "round_up") return TailStrategy::RoundUp;
+    if (t == "guard_with_if") return TailStrategy::GuardWithIf;
+    return TailStrategy::ShiftInwards;
+}
+
+static void apply_directive(PipelineDef &p, const Directive &d) {
+    Func f = p.funcs[d.func];
+    const std::vector<std::string> &a = d.args;
+    if (d.op == "split") {
+        f.split(Var(a[0]), Var(a[1]), Var(a[2]), atoi(a[3].c_str()), tail_of(d, 4));
+    } else if (d.op == "tile") {
+        f.tile(Var(a[0]), Var(a[1]), Var(a[2]), Var(a[3]), Var(a[4]), Var(a[5]),
+               atoi(a[6].c_str()), atoi(a[7].c_str()), tail_of(d, 8));
+    } else if (d.op == "reorder") {
+        std::vector<VarOrRVar> vars;
+        for (const std::string &v : a) vars.push_back(Var(v));
+        f.reorder(vars);
+    } else if (d.op == "vectorize") {
+        if (a.size() == 1) {
+            f.vectorize(Var(a[0]));
+        } else {
+            f.vectorize(Var(a[0]), atoi(a[1].c_str()), tail_of(d, 2));
+        }
+    } else if (d.op == "parallel") {
+        f.parallel(Var(a[0]));
+    } else if (d.op == "compute_at") {
+        f.compute_at(p.funcs[a[0]], Var(a[1]));
+    } else if (d.op == "store_at") {
+        f.store_at(p.funcs[a[0]], Var(a[1]));
+    } else if (d.op == "compute_root") {
+        f.compute_root();
+    } else if (d.op == "store_root") {
+        f.store_root();
+    }
+}
+
+// The checker should have caught every mistake, but Halide has the
+// last word. If it rejects a directive anyway, report that directive's
+// line rather than letting the error take the program down. (This
+// needs a libHalide built with exceptions, which is the default.)
+// 检查器应该已经发现了所有错误，但最终由Halide决定。如果它仍然拒绝某条指令，就报告那条指令的行号，而不是
+// 让错误终止整个程序。（这需要libHalide在构建时启用了异常，这是默认设置。）
+static bool apply_schedule(PipelineDef &p, const ScheduleConfig &config, std::string *error) {
+    for (const Directive &d : config.directives) {
+        try {
+            apply_directive(p, d);
+        } catch (const Halide::Error &e) {
+            *error = config.file + ":" + std::to_string(d.line) + ": Halide rejected '" +
+                     d.func + " " + d.op + "': " + e.what();
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------
+// Putting it together
+// 组合起来
+// ---------------------------------------------------------------------
+
+static bool read_file(const std::string &path, std::string *text) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::stringstream s;
+    s << in.rdbuf();
+    *text = s.str();
+    return true;
+}
+
+static PipelineDef make_pipeline(const std::string &name, Buffer<uint8_t> image, bool *found) {
+    *found = true;
+    if (name == "lesson_05") return make_lesson_05();
+    if (name == "lesson_07") return make_lesson_07(image);
+    if (name == "lesson_08") return make_lesson_08();
+    *found = false;
+    return PipelineDef();
+}
+
+static Realization realize(PipelineDef &p) {
+    if (p.channels) return p.output.realize(p.width, p.height, p.channels);
+    return p.output.realize(p.width, p.height);
+}
+
+// Checks a schedule file and, if it's legal, times it against the
+// same pipeline with no schedule at all, and compares their results.
+// Returns false if the schedule is rejected or gives a wrong answer.
+// 检查一个调度文件，如果合法，就与完全没有调度的同一流水线比较时间和结果。调度被拒绝或者结果错误时返回false。
+static bool run_schedule(const std::string &file, const std::string &text, Buffer<uint8_t> image) {
+    ScheduleConfig config;
+    std::string error;
+    if (!parse_schedule(file, text, &config, &error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    bool found;
+    PipelineDef scheduled = make_pipeline(config.pipeline, image, &found);
+    if (!found) {
+        printf("%s: unknown pipeline '%s'\n", file.c_str(), config.pipeline.c_str());
+        return false;
+    }
+    ScheduleChecker checker(scheduled, config);
+    if (!checker.check(&error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    if (!apply_schedule(scheduled, config, &error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    PipelineDef plain = make_pipeline(config.pipeline, image, &found);
+
+    // Some problems only show up once the whole pipeline is lowered;
+    // those can't be pinned on one line.
+    // 有些问题只有在整个流水线lower时才会出现，无法归到某一行上。
+    try {
+        scheduled.output.compile_jit();
+    } catch (const Halide::Error &e) {
+        printf("%s: Halide rejected the schedule: %s\n", file.c_str(), e.what());
+        return false;
+    }
+    plain.output.compile_jit();
+    Realization expected = realize(plain);
+    Realization actual = realize(scheduled);
+    double t_plain = benchmark(5, 1, [&]() { realize(plain); });
+    double t_scheduled = benchmark(5, 1, [&]() { realize(scheduled); });
+
+    // Lesson 8's sin() may be evaluated differently once vectorized,
+    // so floats are compared with the same tolerance it uses.
+    // 第八课的sin()向量化之后的计算方式可能不同，所以浮点数使用与第八课相同的容差进行比较。
+    Buffer<> e = expected[0], a = actual[0];
+    bool same = true;
+    if (e.type() == Float(32)) {
+        Buffer<float> ef = e, af = a;
+        ef.for_each_element([&](int x, int y) {
+            if (fabs(ef(x, y) - af(x, y)) > 0.001f) same = false;
+        });
+    } else {
+        same = memcmp(e.data(), a.data(), e.size_in_bytes()) == 0;
+    }
+    if (!same) {
+        printf("%s: the schedule changed the result\n", file.c_str());
+        return false;
+    }
+    printf("%-36s %-10s unscheduled %8.2f ms, scheduled %8.2f ms\n",
+           file.c_str(), config.pipeline.c_str(), t_plain * 1e3, t_scheduled * 1e3);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Buffer<uint8_t> image(1920, 1080, 3);
+    fill_synthetic(image);
+
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) files.push_back(argv[i]);
+
+    if (!files.empty()) {
+        // Schedules given on the command line: any rejected one is a
+        // failure.
+        // 命令行给出的调度：任何一个被拒绝都算失败。
+        bool ok = true;
+        for (const std::string &f : files) {
+            std::string text;
+            if (!read_file(f, &text)) {
+                printf("Can't read %s\n", f.c_str());
+                return -1;
+            }
+            ok = run_schedule(f, text, image) && ok;
+        }
+        if (!ok) return -1;
+        printf("Success!\n");
+        return 0;
+    }
+
+    // The samples: lesson 5's tiles, lesson 7's strips and lesson 8's
+    // mixed strategy, as schedule files.
+    // 示例：第五课的分块、第七课的条带和第八课的混合策略，都写成了调度文件。
+    const char *samples[] = {
+        "schedules/lesson_05_tiles.sched",
+        "schedules/lesson_07_strips.sched",
+        "schedules/lesson_08_mixed.sched",
+    };
+    for (const char *f : samples) {
+        std::string text;
+        if (!read_file(f, &text)) {
+            printf("Can't read %s; run this from the directory containing schedules/\n", f);
+            return -1;
+        }
+        if (!run_schedule(f, text, image)) return -1;
+    }
+
+    // And some mistakes, each of which must be caught before Halide
+    // sees it.
+    // 还有一些错误，每一个都必须在交给Halide之前被发现。
+    printf("\nRejected schedules:\n");
+    const char *mistakes[] = {
+        // y no longer exists once it has been split.
+        // y被拆分之后就不存在了。
+        "pipeline lesson_08\n"
+        "consumer split y yo yi 16\n"
+        "consumer parallel y\n",
+        // The producer has to be computed at a loop of its consumer.
+        // 生产者必须在它的消费者的某个循环中计算。
+        "pipeline lesson_07\n"
+        "blur_y compute_at blur_x y\n",
+        // Storage inside the compute level.
+        // 存储位置在计算位置的内部。
+        "pipeline lesson_08\n"
+        "consumer split y yo yi 16\n"
+        "producer store_at consumer yi\n"
+        "producer compute_at consumer yo\n",
+        // blur_x is computed at the root, outside the loop of blur
+        // that input_16 is computed at, yet it reads input_16.
+        // blur_x计算在根上，位于input_16计算所在的blur的循环之外，但它读取input_16。
+        "pipeline lesson_07\n"
+        "blur split y yo yi 32\n"
+        "input_16 compute_at blur yi\n"
+        "blur_x compute_root\n",
+        // blur_y is inlined, so it has no loops.
+        // blur_y被内联了，所以它没有循环。
+        "pipeline lesson_07\n"
+        "blur_x compute_at blur_y y\n",
+        // x has no constant extent to make a vector of.
+        // x没有常数范围，无法构成向量。
+        "pipeline lesson_05\n"
+        "gradient_fast vectorize x\n",
+        // unroll isn't a directive the format knows.
+        // unroll不是这个格式所支持的指令。
+        "pipeline lesson_05\n"
+        "gradient_fast unroll x 4\n",
+    };
+    int n = 0;
+    for (const char *text : mistakes) {
+        std::string name = "mistake_" + std::to_string(++n);
+        if (run_schedule(name, text, image)) {
+            printf("%s should have been rejected\n", name.c_str());
+            return -1;
+        }
+    }
+
+    // Nothing in the unscheduled pipelines or the files is compiled
+    // into this program's schedules, so a new machine type can get
+    // its own schedule file without rebuilding anything. The checks
+    // don't make a schedule fast - only timing can tell you that -
+    // but they make sure a bad file fails immediately, with a line
+    // number, instead of partway through deployment.
+    // 无论是未调度的流水线还是调度文件，都没有把调度编译进程序里，所以新的机器类型可以拥有自己的调度文件而不需
+    // 要重新构建任何东西。这些检查并不能让调度变快——只有计时才能告诉你这一点——但它们保证了错误的文件会立即失败
+    // 并给出行号，而不是在部署到一半时才出问题。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,293 @@
+// Halide tutorial lesson 33: Checking results with Halide reductions
+// Halide入门教程第三十三课：用Halide归约来检查结果
+
+// Every lesson so far checks its output with a pair of nested C++ loops
+// that compare one pixel at a time: output(i, j) != i + j in lesson 1,
+// the shifted gradient in lesson 6, gradient_fast in lesson 5, and the
+// 0.001 tolerance in lesson 8. That's fine at 800x600, but on a full
+// size regression run the check, serial and scalar, can take longer
+// than the parallel, vectorized pipeline it is checking.
+//
+// The check is itself a pipeline: a per-pixel difference followed by
+// reductions over the image. So we write it in Halide, as one pass
+// that produces three things at once:
+// - the largest absolute error,
+// - the number of pixels whose error is over the tolerance,
+// - the first such pixel in scan order, as an argmin of its position.
+// and schedule it with rfactor, like the histogram in lesson 20, so it
+// runs in parallel over strips and vectorized across each row.
+// 到目前为止，每一课都用一对嵌套的C++循环一次比较一个像素来检查输出：第一课中的output(i, j) != i + j，
+// 第六课中平移后的梯度，第五课中的gradient_fast，以及第八课中0.001的容差。在800x600的尺寸上这没有问题，
+// 但在全尺寸的回归测试中，这种串行、标量的检查可能比它所检查的并行、向量化的流水线还要慢。
+//
+// 检查本身也是一个流水线：逐像素的差值，然后在整幅图像上进行归约。所以我们用Halide来写它，一遍同时得到
+// 三个结果：最大绝对误差、误差超过容差的像素数、按扫描顺序第一个这样的像素（作为位置的argmin）。并像
+// 第二十课的直方图那样用rfactor来调度，让它按条带并行，并在每一行上向量化。
+
+// On linux, you can compile and run it like so:
+// g++ lesson_33*.cpp -g -std=c++11 -I ../include -I ../tools -L ../bin -lHalide -lpthread -ldl -o lesson_33
+// LD_LIBRARY_PATH=../bin ./lesson_33
+
+#include "Halide.h"
+#include <stdio.h>
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "halide_benchmark.h"
+#include "tools/lesson_08_pipeline.h"
+
+using namespace Halide;
+using Halide::Tools::benchmark;
+
+struct ValidationResult {
+    float max_error;
+    int mismatches;
+    // Only meaningful when mismatches > 0.
+    // 只有在mismatches > 0时才有意义。
+    int first_x, first_y;
+
+    bool operator==(const ValidationResult &o) const {
+        return max_error == o.max_error && mismatches == o.mismatches &&
+               (mismatches == 0 || (first_x == o.first_x && first_y == o.first_y));
+    }
+};
+
+// Compares the image in 'actual' with 'expected', a Func giving the
+// right value at each (x, y), over actual's whole domain, wherever it
+// starts. The two must have the same type. Counts and positions are
+// 32-bit, which covers images up to 2^31 pixels.
+// 在'actual'的整个定义域上（无论它从哪里开始）把其中的图像与'expected'进行比较，'expected'是给出每个
+// (x, y)处正确值的Func。两者的类型必须相同。计数和位置都是32位的，可以覆盖最多2^31个像素的图像。
+class Validator {
+public:
+    Validator(ImageParam actual, Func expected)
+        : actual(actual), tolerance("tolerance"), check("check") {
+        Expr min_x = actual.dim(0).min(), width = actual.dim(0).extent();
+        Expr min_y = actual.dim(1).min(), height = actual.dim(1).extent();
+        RDom r(min_x, width, min_y, height);
+
+        // absd gives the exact difference for integers too, before the
+        // cast to float. Writing the test as !(error <= tolerance)
+        // makes a NaN count as a mismatch.
+        // absd对整数也能给出准确的差值，然后才转换为float。把判断写成!(error <= tolerance)，NaN也会被算作不匹配。
+        Expr error = cast<float>(absd(actual(r.x, r.y), expected(r.x, r.y)));
+        Expr bad = !(error <= tolerance);
+        Expr position = (r.y - min_y) * width + (r.x - min_x);
+
+        // Each element of the Tuple is its own associative reduction:
+        // max, sum and min. The first mismatch is the one with the
+        // smallest position, and a pixel that matches contributes
+        // INT_MAX, which never wins.
+        // Tuple的每个元素都是独立的满足结合律的归约：最大值、求和与最小值。第一个不匹配的像素就是位置最小的
+        // 那个，匹配的像素贡献INT_MAX，永远不会被选中。
+        check() = Tuple(0.0f, 0, INT_MAX);
+        check() = Tuple(max(check()[0], error),
+                        check()[1] + select(bad, 1, 0),
+                        min(check()[2], select(bad, position, INT_MAX)));
+
+        // Split the rows into strips and the columns into vectors, and
+        // rfactor both: the intermediate has one partial result per
+        // strip (u) and per vector lane (v). The strips run in parallel
+        // and the lanes are a vector, and check() then combines the
+        // partial results.
+        // 把行拆成条带、把列拆成向量，并对两者都做rfactor：中间函数对每个条带（u）和每个向量通道（v）各有
+        // 一个部分结果。条带并行执行，通道构成一个向量，最后由check()合并这些部分结果。
+        RVar rxo("rxo"), rxi("rxi"), ryo("ryo"), ryi("ryi");
+        Var u("u"), v("v");
+        check.update().split(r.y, ryo, ryi, 16).split(r.x, rxo, rxi, 8);
+        Func partial = check.update().rfactor({{ryo, u}, {rxi, v}});
+        partial.compute_root().vectorize(v);
+        partial.update().reorder(v, rxo, ryi, u).vectorize(v).parallel(u);
+
+        check.compile_jit();
+    }
+
+    ValidationResult run(Buffer<> image, float tol) {
+        actual.set(image);
+        tolerance.set(tol);
+        Buffer<float> max_error = Buffer<float>::make_scalar();
+        Buffer<int> mismatches = Buffer<int>::make_scalar();
+        Buffer<int> first = Buffer<int>::make_scalar();
+        check.realize({max_error, mismatches, first});
+
+        ValidationResult result;
+        result.max_error = max_error();
+        result.mismatches = mismatches();
+        result.first_x = image.dim(0).min() + first() % image.dim(0).extent();
+        result.first_y = image.dim(1).min() + first() / image.dim(0).extent();
+        return result;
+    }
+
+private:
+    ImageParam actual;
+    Param<float> tolerance;
+    Func check;
+};
+
+// The same three results from the kind of loop the lessons use, to
+// check the Halide version against and to time it.
+// 用各课中那种循环得到同样的三个结果，用来检查Halide版本并与它比较时间。
+template<typename T, typename F>
+ValidationResult scalar_validate(const Buffer<T> &image, F expected, float tol) {
+    ValidationResult result = {0.0f, 0, 0, 0};
+    for (int y = image.dim(1).min(); y <= image.dim(1).max(); y++) {
+        for (int x = image.dim(0).min(); x <= image.dim(0).max(); x++) {
+            T a = image(x, y), e = expected(x, y);
+            float error = (float)(a > e ? a - e : e - a);
+            result.max_error = std::max(result.max_error, error);
+            if (!(error <= tol)) {
+                if (result.mismatches++ == 0) {
+                    result.first_x = x;
+                    result.first_y = y;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+// Runs both checks on one image, makes sure they agree, and times them.
+// 在一幅图像上运行两种检查，确认它们一致，并比较时间。
+template<typename T, typename F>
+bool compare(const char *name, Validator &validator, const Buffer<T> &image, F expected, float tol) {
+    ValidationResult fast = validator.run(image, tol);
+    ValidationResult slow = scalar_validate(image, expected, tol);
+    double t_fast = benchmark(5, 1, [&]() { validator.run(image, tol); });
+    double t_slow = benchmark(1, 1, [&]() { scalar_validate(image, expected, tol); });
+
+    printf("%-28s %5dx%-5d max error %-10g mismatches %-8d", name,
+           image.width(), image.height(), fast.max_error, fast.mismatches);
+    if (fast.mismatches) {
+        printf(" first (%d, %d)", fast.first_x, fast.first_y);
+    }
+    printf("\n%28s scalar loop %8.2f ms, Halide %7.2f ms\n", "", t_slow * 1e3, t_fast * 1e3);
+
+    if (!(fast == slow)) {
+        printf("The Halide check disagrees with the scalar loop: "
+               "max error %g vs %g, %d vs %d mismatches, first (%d, %d) vs (%d, %d)\n",
+               fast.max_error, slow.max_error, fast.mismatches, slow.mismatches,
+               fast.first_x, fast.first_y, slow.first_x, slow.first_y);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    // Production sizes, rather than the lessons' small ones.
+    // 使用实际生产中的尺寸，而不是各课中的小尺寸。
+    const int W = 8192, H = 8192;
+
+    Var x("x"), y("y");
+    ImageParam int_image(Int(32), 2, "int_image");
+    ImageParam float_image(Float(32), 2, "float_image");
+
+    // Lessons 1, 5 and 6 all compute x + y, so one validator covers
+    // them: it is compiled once and used for every check.
+    // 第一、五、六课计算的都是x + y，所以一个验证器就能覆盖它们：只编译一次，用于所有的检查。
+    Func sum_of_coordinates("sum_of_coordinates");
+    sum_of_coordinates(x, y) = x + y;
+    Validator gradient_check(int_image, sum_of_coordinates);
+    auto gradient_expected = [](int x, int y) { return x + y; };
+
+    // Lesson 1: the gradient, realized over the whole image.
+    // 第一课：在整幅图像上计算的梯度。
+    {
+        Func gradient("gradient");
+        gradient(x, y) = x + y;
+        Buffer<int> output = gradient.realize(W, H);
+        if (!compare("lesson 1 gradient", gradient_check, output, gradient_expected, 0.0f)) return -1;
+    }
+
+    // Lesson 6: the same gradient over a shifted domain. The validator
+    // reads the domain from the buffer, so nothing changes.
+    // 第六课：在平移后的定义域上计算同样的梯度。验证器从buffer中读取定义域，所以什么都不用改。
+    {
+        Func gradient("gradient");
+        gradient(x, y) = x + y;
+        Buffer<int> shifted(W, H);
+        shifted.set_min(100, 50);
+        gradient.realize(shifted);
+        if (!compare("lesson 6 shifted gradient", gradient_check, shifted, gradient_expected, 0.0f)) return -1;
+    }
+
+    // Lesson 5: gradient_fast, with a size that isn't a multiple of
+    // its 64x64 tiles so the shifted edge tiles are checked too. Then
+    // some damage, to show what a failure looks like.
+    // 第五课：gradient_fast，尺寸不是64x64块的整数倍，所以向内平移的边缘块也会被检查。然后破坏一些像素，
+    // 看看失败是什么样子的。
+    {
+        Var x_outer, y_outer, x_inner, y_inner, tile_index;
+        Var x_inner_outer, y_inner_outer, x_vectors, y_pairs;
+        Func gradient_fast("gradient_fast");
+        gradient_fast(x, y) = x + y;
+        gradient_fast
+            .tile(x, y, x_outer, y_outer, x_inner, y_inner, 64, 64)
+            .fuse(x_outer, y_outer, tile_index)
+            .parallel(tile_index);
+        gradient_fast
+            .tile(x_inner, y_inner, x_inner_outer, y_inner_outer, x_vectors, y_pairs, 4, 2)
+            .vectorize(x_vectors)
+            .unroll(y_pairs);
+        Buffer<int> result = gradient_fast.realize(W - 10, H - 6);
+        if (!compare("lesson 5 gradient_fast", gradient_check, result, gradient_expected, 0.0f)) return -1;
+
+        result(5000, 300) += 3;
+        result(17, 4000) -= 1;
+        result(W - 11, H - 7) = 0;
+        if (!compare("lesson 5, three bad pixels", gradient_check, result, gradient_expected, 0.0f)) return -1;
+        if (gradient_check.run(result, 0.0f).mismatches != 3) {
+            printf("Expected three mismatches\n");
+            return -1;
+        }
+    }
+
+    // Lesson 8: the mixed schedule against a reference, with its 0.001
+    // tolerance. The reference here is the same algorithm with the
+    // producer computed at the root in scalar code, standing in for
+    // lesson 8's hand-written C.
+    // 第八课：把混合调度与参考结果比较，使用0.001的容差。这里的参考结果是同一个算法，生产者在根上用标量代码
+    // 计算，代替第八课中手写的C代码。
+    {
+        auto make = [&](bool fast) {
+            ProducerConsumer p;
+            Var yo("yo"), yi("yi");
+            if (fast) {
+                p.consumer.split(y, yo, yi, 16).parallel(yo).vectorize(x, 4);
+                p.producer.store_at(p.consumer, yo).compute_at(p.consumer, yi).vectorize(x, 4);
+            } else {
+                p.producer.compute_root();
+            }
+            return p.consumer;
+        };
+        const int N = 4096;
+        Buffer<float> reference = make(false).realize(N, N);
+        Buffer<float> halide_result = make(true).realize(N, N);
+
+        // The expected image is another input, so this validator
+        // reads it from a buffer of its own.
+        // 期望的图像是另一个输入，所以这个验证器从它自己的buffer中读取。
+        ImageParam reference_image(Float(32), 2, "reference_image");
+        Func from_reference("from_reference");
+        from_reference(x, y) = reference_image(x, y);
+        reference_image.set(reference);
+        Validator consumer_check(float_image, from_reference);
+        auto consumer_expected = [&](int x, int y) { return reference(x, y); };
+        if (!compare("lesson 8 consumer", consumer_check, halide_result, consumer_expected, 0.001f)) return -1;
+    }
+
+    // The Halide checks agree exactly with the loops, including the
+    // first mismatch, and run tens of times faster: the loops do one
+    // compare per iteration on one core, while the check runs 8 lanes
+    // per instruction across all the cores. The check is also just one
+    // pass over memory, so at these sizes it runs at about the speed the
+    // pipeline under test writes its output, and it no longer
+    // dominates a regression run. Compile each validator once, and
+    // reuse it for every image of the same type and expected value.
+    // Halide的检查与循环的结果完全一致，包括第一个不匹配的位置，并且快几十倍：循环在一个核上每次迭代做一次比较，
+    // 而这个检查在所有核上每条指令处理8个通道。检查也只需要遍历一遍内存，所以在这些尺寸上它的速度与被测流水线
+    // 写输出的速度相当，不再是回归测试中最耗时的部分。每个验证器只编译一次，用于所有相同类型和相同期望值的图像。
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,35 @@
+// The algorithm of lesson 8, unscheduled.
+// 第八课的算法，未加调度。
+
+// From lesson 29 on, several lessons take lesson 8's producer-consumer
+// pipeline exactly as it is and only study its schedule: how much it
+// recomputes, how tall its strips should be, and how to serve, load
+// and check it. They build it from here. Lessons that change the
+// algorithm itself - an asynchronous producer, memoization, half
+// precision storage, generators - still write their own version, since
+// that change is what they teach. Include it as
+// "tools/lesson_08_pipeline.h".
+// 从第二十九课开始，有几课原样使用第八课的生产者-消费者流水线，只研究它的调度：重复计算了多少，条带应该多高，
+// 以及如何提供服务、加载调度和检查结果。它们从这里构建这个算法。修改算法本身的课程——异步生产者、记忆化、
+// 半精度存储、生成器——仍然各自写出自己的版本，因为那些修改正是它们要讲的内容。以"tools/lesson_08_pipeline.h"
+// 的方式包含。
+
+#ifndef LESSON_08_PIPELINE_H
+#define LESSON_08_PIPELINE_H
+
+#include "Halide.h"
+
+struct ProducerConsumer {
+    Halide::Func producer, consumer;
+    Halide::Var x, y;
+
+    ProducerConsumer() : producer("producer"), consumer("consumer"), x("x"), y("y") {
+        producer(x, y) = sin(x * y);
+        consumer(x, y) = (producer(x, y) +
+                          producer(x, y+1) +
+                          producer(x+1, y) +
+                          producer(x+1, y+1))/4;
+    }
+};
+
+#endif
@@ -0,0 +1,44 @@
+// The synthetic input image shared by the later lessons.
+// 后面几课共用的合成输入图像。
+
+// Most lessons from 9 on time a pipeline over a 4K or 8K frame. Rather
+// than depend on a big image lying around, they fill their input with
+// this deterministic pattern. The gradients in x, y and c give every
+// channel and every row different values, and the xor with x >> 3
+// breaks them up, so the image doesn't compress to nothing and a pixel
+// read from the wrong place changes the result.
+// 从第九课开始，大多数课程都在4K或8K图像上对流水线计时。为了不依赖外部的大图像文件，它们用这个确定性的图案
+// 填充输入。x、y、c方向的渐变使每个通道、每一行的值都不同，与x >> 3异或又把渐变打散，所以图像不会被压缩得
+// 几乎为零，从错误位置读取的像素也会改变结果。
+
+// Include it as "tools/synthetic_image.h"; it only needs the buffer
+// type, so it works with both Halide::Buffer in the JIT lessons and
+// Halide::Runtime::Buffer in the ahead-of-time ones.
+// 以"tools/synthetic_image.h"的方式包含。它只用到buffer类型，所以既可以用于即时编译课程中的Halide::Buffer，
+// 也可以用于预先编译课程中的Halide::Runtime::Buffer。
+
+#ifndef LESSON_SYNTHETIC_IMAGE_H
+#define LESSON_SYNTHETIC_IMAGE_H
+
+#include <stdint.h>
+
+// One pixel. n is the image's index within a batch, so the images of a
+// batch differ from each other.
+// 一个像素。n是图像在批次中的序号，使同一批次中的图像互不相同。
+inline uint8_t synthetic_pixel(int x, int y, int c, int n = 0) {
+    return (uint8_t)((x * 7 + y * 13 + c * 101 + n * 31) ^ (x >> 3));
+}
+
+// Fill a uint8 buffer of two to four dimensions (x, y, c, n) with the
+// pattern. The buffer may wrap memory that something else owns, such
+// as shared memory.
+// 用这个图案填充一个二到四维(x, y, c, n)的uint8 buffer。buffer可以指向别处拥有的内存，例如共享内存。
+template<typename BufferType>
+inline void fill_synthetic(BufferType &image) {
+    const int d = image.dimensions();
+    image.for_each_element([&](const int *pos) {
+        image(pos) = synthetic_pixel(pos[0], pos[1], d > 2 ? pos[2] : 0, d > 3 ? pos[3] : 0);
+    });
+}
+
+#endif